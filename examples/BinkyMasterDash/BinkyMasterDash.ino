@@ -4,15 +4,52 @@
 
 #include <Wire.h>
 #include <DashMessage.h>
+#include <MasterInputs.h>
+
+// send changes as soon as they happen, and a heartbeat when nothing is happening.
+// frames are numbered, so the slave can tell when it misses one
+DashSender sender(WIRE_PROTOCOL_MIN_GAP_MS, WIRE_PROTOCOL_HEARTBEAT_MS, true);
+
+// the pins, as caught by the pin-change interrupts
+MasterInputs inputs;
+
+// the boost reading last sent.  it only moves when the sensor is clear of the deadband, so a
+// noisy reading doesn't turn into a stream of frames
+uint16_t boostPressure = 0;
+
+// every input pin change lands here
+void onPinChange() {
+  inputs.capture(PortSnapshot::sample(), millis());
+}
+
+#ifdef PCICR
+// the master pins are D3-D7 (port D, PCINT19-23) and D8-D12 (port B, PCINT0-4)
+ISR(PCINT0_vect) { onPinChange(); }
+ISR(PCINT2_vect) { onPinChange(); }
+#endif
 
 void setup() {
   Wire.begin(); // I2C bus master -- no ID
   pinMode(LED_BUILTIN, OUTPUT);
+
+  inputs.capture(PortSnapshot::sample(), millis()); // the pins as they are before any change
+
+#ifdef PCICR
+  PCMSK2 |= 0b11111000; // D3-D7
+  PCMSK0 |= 0b00011111; // D8-D12
+  PCIFR  |= bit(PCIF0) | bit(PCIF2);
+  PCICR  |= bit(PCIE0) | bit(PCIE2);
+#else
+  // boards without pin-change interrupts can usually interrupt on any pin
+  for (pin_size_t p = MasterPin::Values::boostWarning; p <= MasterPin::Values::scrollBrightness; ++p) {
+    attachInterrupt(digitalPinToInterrupt(p), onPinChange, CHANGE);
+  }
+#endif
 }
 
 void loop() {
-  DashMessage d(digitalRead); // create a message from the current state of pins
-  d.send(Wire, SLAVE_I2C_ADDRESS);
-
-  delay(20); // not sure how often we need to send updates, but ~50 times per second is probably OK
+  DashMessage d = inputs.message(millis());
+  boostPressure = MasterField::boostPressure::fromAnalog(analogRead(MasterPin::Values::boostPressure), boostPressure);
+  d.setField<MasterField::boostPressure>(boostPressure);
+  sender.process(Wire, SLAVE_I2C_ADDRESS, d, millis());
 }
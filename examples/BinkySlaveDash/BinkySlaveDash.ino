@@ -12,64 +12,30 @@
 #include <SlaveProperties.h>
 #include <DashMessage.h>
 #include <DashState.h>
+#include <DashCapture.h>
 
-// work around a VERY ANNOYING PROBLEM with how arduino defines its internal functions
-#ifndef pin_size_t
-  void myPinMode(unsigned char pin, unsigned char mode) {
-    pinMode(pin, mode);
-  }
+// The dash reaches the hardware through the Arduino functions, bound at compile time.
+// (the unit tests swap in a DashSupport table of mock functions instead)
+DashStateT<ArduinoSupport> dash(ArduinoSupport{&FastLED});
 
-  int myAnalogRead(unsigned char pin) {
-    return analogRead(pin);
-  }
+// recording a capture of the drive, to replay on the bench with extras/host/replay_capture.
+// set this and log the serial port to a file; it can't be used along with the serial debugging
+const bool recordCapture = false;
+DashCaptureWriter<decltype(Serial)> recorder(Serial);
 
-  int myDigitalRead(unsigned char pin) {
-    return digitalRead(pin);
-  }
-
-  void myDigitalWrite(unsigned char pin, int val) {
-    digitalWrite(pin, val);
-  }
-#else
-  void myPinMode(pin_size_t pin, pin_size_t mode) {
-    pinMode(pin, mode);
-  }
-
-  int myAnalogRead(pin_size_t pin) {
-    return analogRead(pin);
-  }
-
-  int myDigitalRead(pin_size_t pin) {
-    return digitalRead(pin);
-  }
-
-  void myDigitalWrite(pin_size_t pin, int val) {
-    digitalWrite(pin, val);
-  }
-#endif
-
-
-
-// This just provides all the library functions the DashState.h file will need.
-// Doing it this way allows us to swap in different functions for unit testing.
-DashSupport ds = {
-  myPinMode,
-  myAnalogRead,
-  myDigitalRead,
-  myDigitalWrite,
-  &FastLED
-};
-
-DashState dash(ds);
+// the wire protocol decoder, which keeps its place from one transaction to the next.
+// the master numbers its frames, so this expects a sequence number after each one
+DashDecoder decoder(true);
 
 void receiveDashMessage(int /* bytes */) {
-  DashMessage dm;
-  // consume all available messages
-  while (Wire.available() >= (int)WIRE_PROTOCOL_MESSAGE_LENGTH) {
-    // decode a message.  if it's valid, pass it along to the dash
-    dm.setFromWire(Wire);
-    if (!dm.isError()) {
-      dash.setMessage(dm);
+  // decode the bytes as they come.  each complete frame goes to the dash, and each loss of
+  // framing is counted.  we're in an interrupt here, so the dash will pick it up on its next apply()
+  while (Wire.available()) {
+    switch (decoder.push(Wire.read())) {
+      case DashDecoder::Event::frame:    dash.postMessage(decoder.message, millis()); break;
+      case DashDecoder::Event::sequence: dash.postSequence(decoder.lastSequence); break;
+      case DashDecoder::Event::dropped:  dash.dropMessage(); break;
+      default: break;
     }
   }
 }
@@ -83,8 +49,14 @@ void setup() {
 
   // serial debugging
   // Serial.begin(1000000);
+  if (recordCapture) {
+    Serial.begin(1000000);
+    recorder.begin();
+  }
 
   dash.setup();
+  dash.link.staleTimeoutMs = LINK_STALE_TIMEOUT_MS; // a silent master means its indicators go dark
+  dash.renderer.mode = RenderMode::Values::dirtyPrefix; // only send the changed part of the strip
 
   Wire.begin(SLAVE_I2C_ADDRESS);      // Start the I2C Bus as Slave on address
   Wire.onReceive(receiveDashMessage); // Attach a function to trigger when something is received.
@@ -92,8 +64,9 @@ void setup() {
 
 void loop() {
   const unsigned long currentMillis = millis();
-  dash.setSlaveState(myDigitalRead, myAnalogRead);
+  dash.setSlaveState(PortSnapshot::sample()); // the digital pins are read a port at a time
 
   dash.apply(currentMillis);
+  if (recordCapture) recorder.record(dash.state(), currentMillis); // what the dash was given, before debouncing
   // Serial.println(dash.lastStateString(currentMillis));
 }
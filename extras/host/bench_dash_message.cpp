@@ -0,0 +1,103 @@
+// Times the wire protocol on the host, so that a change to the format comes with numbers.
+// These are nanoseconds on whatever machine runs it, not on the board: compare runs on the
+// same machine, before and after a change, rather than against the AVR's clock.
+//
+// usage: bench_dash_message [iterations]
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "DashMessage.h"
+
+#include <chrono>
+#include <stdlib.h>
+
+int hostPins[32];
+TwoWire Wire;
+
+const unsigned int LENGTH = DashMessage::length;
+
+// keeps the compiler from throwing away the work being timed
+static volatile unsigned long sink;
+
+// the best of several runs of an operation, in ns per call
+template <typename Op>
+static double timeIt(unsigned long iterations, Op op) {
+  double best = 1e30;
+  for (int run = 0; run < 5; ++run) {
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < iterations; ++i) op(i);
+    const auto end = std::chrono::steady_clock::now();
+    const double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+    if (ns < best) best = ns;
+  }
+  return best;
+}
+
+static void report(const char *name, double ns) {
+  printf("  %-28s %8.1f ns  %8.2f M/s\n", name, ns, 1e3 / ns);
+}
+
+int main(int argc, char **argv) {
+  const unsigned long iterations = argc > 1 ? strtoul(argv[1], 0, 10) : 2000000;
+  printf("%u-byte DashMessage, %u payload bits, best of 5 x %lu\n", LENGTH, MASTER_PAYLOAD_BITS, iterations);
+
+  // a spread of messages to encode and streams to decode
+  const unsigned int VARIETY = 256;
+  DashMessage messages[VARIETY];
+  byte stream[VARIETY * (LENGTH + 1)];
+  for (unsigned int v = 0; v < VARIETY; ++v) {
+    for (unsigned int p = 0; p < 10; ++p) hostPins[MasterPin::Values::boostWarning + p] = (v * 37 >> p) & 1;
+    messages[v] = DashMessage(digitalRead);
+    messages[v].setField<MasterField::boostPressure>(v & 0x0F);
+    for (unsigned int i = 0; i < LENGTH; ++i) stream[v * (LENGTH + 1) + i] = messages[v].rawData[i];
+    stream[v * (LENGTH + 1) + LENGTH] = v & 0x7F; // a sequence number
+  }
+
+  report("send", timeIt(iterations, [&](unsigned long i) {
+    sink += messages[i % VARIETY].send(Wire, SLAVE_I2C_ADDRESS);
+    sink += Wire.tx[0];
+  }));
+
+  report("send, numbered", timeIt(iterations, [&](unsigned long i) {
+    sink += messages[i % VARIETY].send(Wire, SLAVE_I2C_ADDRESS, (uint8_t)i);
+    sink += Wire.tx[0];
+  }));
+
+  report("setFromWire", timeIt(iterations, [&](unsigned long i) {
+    Wire.receive(messages[i % VARIETY].rawData, LENGTH);
+    DashMessage m;
+    m.setFromWire(Wire);
+    sink += m.rawData[0];
+  }));
+
+  DashDecoder decoder(true); // the stream is numbered
+  const unsigned long streamLength = sizeof(stream);
+  const double perByte = timeIt(iterations * (LENGTH + 1), [&](unsigned long i) {
+    sink += decoder.push(stream[i % streamLength]);
+  });
+  report("DashDecoder, per frame", perByte * (LENGTH + 1));
+
+  report("setFromPins (digitalRead)", timeIt(iterations, [&](unsigned long i) {
+    hostPins[MasterPin::Values::acOn] = i & 1;
+    DashMessage m(digitalRead);
+    sink += m.rawData[0];
+  }));
+
+  report("setFromPorts", timeIt(iterations, [&](unsigned long i) {
+    hostPins[MasterPin::Values::acOn] = i & 1;
+    DashMessage m(PortSnapshot::sample());
+    sink += m.rawData[0];
+  }));
+
+  report("getField + setField", timeIt(iterations, [&](unsigned long i) {
+    DashMessage &m = messages[i % VARIETY];
+    m.setField<MasterField::boostPressure>(m.getField<MasterField::boostPressure>() + 1);
+    sink += m.rawData[1];
+  }));
+
+  report("binaryString", timeIt(iterations / 10, [&](unsigned long i) {
+    sink += messages[i % VARIETY].binaryString().length();
+  }));
+
+  return 0;
+}
@@ -0,0 +1,134 @@
+// Times DashState::apply() on the host, driven by a virtual clock, in each of the situations
+// that cost the dash something different: each effect mode, each warning, boot, and shutdown.
+//
+// For each one it reports the ns per apply() (on the host, so compare like with like), and
+// what the dash asked of the strip per tick: LED evaluations, show() calls, and pixels pushed.
+// Those counts don't depend on the machine, so they're exact from one commit to the next.
+//
+// usage: bench_dash_state [ticks] [ticks per ms] [results file] [label]
+//
+// with a results file, a CSV line per scenario is appended to it, tagged with the label
+// (the Makefile uses the commit), so that a regression shows up as a change between lines
+
+#include "host_support.h"
+
+#include <chrono>
+#include <stdlib.h>
+
+// when the boot animation is over, with the ignition on
+const unsigned long STEADY_MS = ARDUINO_BOOT_ANIMATION_MS + 100;
+
+typedef struct Scenario {
+  const char *name;
+  void (*prepare)(DashState &dash);                         // set the inputs, once the dash has booted
+  void (*tick)(DashState &dash, unsigned long const &nMillis); // anything to do before each apply()
+} Scenario;
+
+void ignitionOn(DashState &dash) {
+  dash.state().ignition = true;
+}
+
+void withMessage(DashState &dash, MasterSignal::Values signal) {
+  DashMessage dm;
+  dm.setBit(signal, true);
+  dash.setMessage(dm);
+}
+
+void withEffect(DashState &dash, EffectMode::Values mode) {
+  dash.state().effectmode.state = mode;
+}
+
+void noTick(DashState &, unsigned long const &) {}
+
+// start the boot over at the end of each boot animation
+void rebootTick(DashState &dash, unsigned long const &nMillis) {
+  if (!dash.inBootSequence(nMillis)) {
+    dash.reset();
+    dash.state().ignition = true;
+  }
+}
+
+// the board runs on after the ignition is turned off only until the soft shutdown is done,
+// so turn the ignition on for a moment whenever it would be
+void shutdownTick(DashState &dash, unsigned long const &nMillis) {
+  dash.state().ignition = !dash.shouldUseOpto(false, nMillis);
+}
+
+const Scenario scenarios[] = {
+  { "steady",         [](DashState &d) { ignitionOn(d); }, noTick },
+  { "rainbow",        [](DashState &d) { ignitionOn(d); withEffect(d, EffectMode::Values::rainbow); }, noTick },
+  { "sparkle",        [](DashState &d) { ignitionOn(d); withEffect(d, EffectMode::Values::sparkle); }, noTick },
+  { "shimmer",        [](DashState &d) { ignitionOn(d); withEffect(d, EffectMode::Values::shimmer); }, noTick },
+  { "boost_critical", [](DashState &d) { ignitionOn(d); withMessage(d, MasterSignal::Values::boostCritical); }, noTick },
+  { "tach_warning",   [](DashState &d) { ignitionOn(d); d.state().tachometerWarning = true; }, noTick },
+  { "tach_critical",  [](DashState &d) { ignitionOn(d); d.state().tachometerCritical = true; }, noTick },
+  { "boot",           [](DashState &d) { d.reset(); ignitionOn(d); }, rebootTick },
+  { "shutdown",       [](DashState &d) { d.state().ignition = false; }, shutdownTick },
+};
+
+typedef struct Result {
+  double nsPerApply;
+  double evaluationsPerTick;
+  double showsPerTick;
+  double pixelsPerTick;
+} Result;
+
+// run a scenario from a fresh dash.  the counts come out the same every time; the time is the best of a few runs
+Result run(Scenario const &scenario, unsigned long ticks, unsigned long ticksPerMs) {
+  Result ret = { 1e30, 0, 0, 0 };
+  for (int attempt = 0; attempt < 3; ++attempt) {
+    DashState dash(hostSupport);
+    dash.setup();
+    ignitionOn(dash);
+    for (unsigned long t = 1; t < STEADY_MS; ++t) dash.apply(t);
+    scenario.prepare(dash);
+    dash.apply(STEADY_MS);
+
+    const unsigned long evaluations = dash.ledSchedule.evaluations;
+    const unsigned long shows = FastLED.numShows;
+    const unsigned long pixels = FastLED.controller.pixelsPushed;
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < ticks; ++i) {
+      const unsigned long t = STEADY_MS + 1 + i / ticksPerMs;
+      scenario.tick(dash, t);
+      dash.apply(t);
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    const double ns = std::chrono::duration<double, std::nano>(end - start).count() / ticks;
+    if (ns < ret.nsPerApply) ret.nsPerApply = ns;
+    ret.evaluationsPerTick = (double)(dash.ledSchedule.evaluations - evaluations) / ticks;
+    ret.showsPerTick = (double)(FastLED.numShows - shows) / ticks;
+    ret.pixelsPerTick = (double)(FastLED.controller.pixelsPushed - pixels) / ticks;
+  }
+  return ret;
+}
+
+int main(int argc, char **argv) {
+  const unsigned long ticks = argc > 1 ? strtoul(argv[1], 0, 10) : 2000000;
+  const unsigned long ticksPerMs = argc > 2 && strtoul(argv[2], 0, 10) ? strtoul(argv[2], 0, 10) : 4;
+  FILE *results = 0;
+  if (argc > 3) {
+    results = fopen(argv[3], "a");
+    if (!results) {
+      perror(argv[3]);
+      return 2;
+    }
+    if (ftell(results) == 0) fprintf(results, "label,scenario,ticks,ticks_per_ms,ns_per_apply,evaluations_per_tick,shows_per_tick,pixels_per_tick\n");
+  }
+  const char *label = argc > 4 ? argv[4] : "";
+
+  printf("%lu ticks per scenario, %lu per ms of virtual time\n", ticks, ticksPerMs);
+  printf("  %-16s %10s %12s %12s %12s\n", "scenario", "ns/apply", "evals/tick", "shows/tick", "pixels/tick");
+  for (unsigned int i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+    const Result r = run(scenarios[i], ticks, ticksPerMs);
+    printf("  %-16s %10.1f %12.5f %12.5f %12.4f\n", scenarios[i].name, r.nsPerApply, r.evaluationsPerTick, r.showsPerTick, r.pixelsPerTick);
+    if (results) {
+      fprintf(results, "%s,%s,%lu,%lu,%.1f,%.6f,%.6f,%.4f\n", label, scenarios[i].name, ticks, ticksPerMs,
+        r.nsPerApply, r.evaluationsPerTick, r.showsPerTick, r.pixelsPerTick);
+    }
+  }
+
+  if (results) fclose(results);
+  return 0;
+}
@@ -0,0 +1,97 @@
+// Makes up a capture of a drive, for replay_capture to play back when there's no real one
+// to hand.  The slave's loop is simulated at a few ms per pass, with the gauges wandering,
+// buttons pressed now and then, warnings coming and going, and the ignition off at the end.
+//
+// usage: capture_synth <capture file> [minutes] [seed]
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "DashCapture.h"
+
+#include <stdlib.h>
+
+int hostPins[32];
+TwoWire Wire;
+
+// writes the capture to a file
+typedef struct FileSink {
+  FILE *f;
+  size_t write(uint8_t b) { return fputc(b, f) == EOF ? 0 : 1; }
+} FileSink;
+
+static uint32_t rngState;
+static uint32_t rnd(uint32_t n) {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState % n;
+}
+
+// a gauge that drifts, with a little noise on every reading like a real ADC
+typedef struct Wander {
+  long value;
+  int read() {
+    if (!rnd(200)) value += (long)rnd(21) - 10;
+    value = value < 0 ? 0 : value > 1023 ? 1023 : value;
+    return value + (rnd(8) ? 0 : (long)rnd(3) - 1);
+  }
+} Wander;
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <capture file> [minutes] [seed]\n", argv[0]);
+    return 2;
+  }
+  const unsigned long minutes = argc > 2 ? strtoul(argv[2], 0, 10) : 60;
+  rngState = argc > 3 ? strtoul(argv[3], 0, 10) : 1;
+  if (!rngState) rngState = 1;
+
+  FileSink sink = { fopen(argv[1], "wb") };
+  if (!sink.f) {
+    perror(argv[1]);
+    return 2;
+  }
+  DashCaptureWriter<FileSink> writer(sink);
+  writer.begin();
+
+  const unsigned long end = 800 + minutes * 60000;
+  Wander fuel = { 700 };
+  Wander temperature = { 300 };
+  Wander oil = { 500 };
+  DashMessage message;
+  unsigned long buttonReleaseTime = 0;
+  MasterSignal::Values button = MasterSignal::Values::scrollCAN;
+
+  SlaveState s;
+  for (unsigned long t = 800; t < end + 5000; t += 2 + rnd(4)) {
+    s.ignition = t < end;
+    if (!rnd(20000)) s.backlightDim = !s.backlightDim;
+    if (!rnd(5000)) s.tachometerWarning = !s.tachometerWarning;
+    s.tachometerCritical = s.tachometerWarning && !rnd(50);
+    s.fuelLevel = fuel.read();
+    s.temperatureLevel = temperature.read();
+    s.oilPressureLevel = oil.read();
+
+    // the master's switches change now and then, and its buttons get a press
+    if (!rnd(3000)) {
+      const MasterSignal::Values sw = (MasterSignal::Values)rnd(MasterSignal::Values::scrollCAN);
+      message.setBit(sw, !message.getBit(sw));
+    }
+    if (buttonReleaseTime && (long)(t - buttonReleaseTime) >= 0) {
+      message.setBit(button, false);
+      buttonReleaseTime = 0;
+    } else if (!buttonReleaseTime && !rnd(10000)) {
+      button = (MasterSignal::Values)(MasterSignal::Values::scrollCAN + rnd(4));
+      message.setBit(button, true);
+      buttonReleaseTime = t + 80 + rnd(300);
+    }
+    if (!rnd(200)) message.setField<MasterField::boostPressure>(rnd(16));
+    s.masterMessage = message;
+
+    writer.record(s, t);
+  }
+
+  fclose(sink.f);
+  printf("%lu minutes: %s\n", minutes, writer.toString().c_str());
+  return 0;
+}
@@ -0,0 +1,330 @@
+// Throws random, truncated, and corrupted byte streams at the slave's readers of the wire
+// protocol, and checks that they:
+//
+//   - never read past what the bus says is available, nor outside their own buffers
+//     (the shim counts the first; build with sanitizers, as "make check" does, for the second)
+//   - never report a frame that breaks the framing rules
+//   - never miss a whole, valid frame once it arrives: the decoder must pick up again within
+//     one frame of any garbage, however the bytes are split into transactions, and with
+//     numbered frames, pick up each frame's sequence number too
+//
+// usage: fuzz_dash_message [iterations] [seed]
+
+#include <Arduino.h>
+#include <Wire.h>
+#include "DashMessage.h"
+
+#include <stdlib.h>
+
+int hostPins[32];
+TwoWire Wire;
+
+const unsigned int LENGTH = DashMessage::length;
+
+// xorshift32, so a failure can be repeated from its seed on any machine
+static uint32_t rngState;
+static uint32_t rnd() {
+  rngState ^= rngState << 13;
+  rngState ^= rngState >> 17;
+  rngState ^= rngState << 5;
+  return rngState;
+}
+static uint32_t rnd(uint32_t n) { return rnd() % n; }
+
+static unsigned long failures = 0;
+#define CHECK(cond, ...) do { \
+  if (!(cond)) { \
+    if (++failures <= 10) { printf("FAIL %s:%d %s -- ", __FILE__, __LINE__, #cond); printf(__VA_ARGS__); printf("\n"); } \
+  } \
+} while (0)
+
+// a well-formed frame with a random payload
+static void randomFrame(byte *frame) {
+  frame[0] = FIRST_FRAME_MARKER_MASK | rnd(0x80);
+  for (unsigned int i = 1; i < LENGTH; ++i) frame[i] = rnd(0x80);
+}
+
+// any byte at all, but biased towards the markers and the values either side of them
+static byte randomByte() {
+  switch (rnd(4)) {
+    case 0:  return FIRST_FRAME_MARKER_MASK;
+    case 1:  return FIRST_FRAME_MARKER_MASK - 1;
+    default: return rnd(0x100);
+  }
+}
+
+// whether a message obeys the framing rules: a marker on the first byte and no other
+static bool wellFramed(DashMessage const &m) {
+  if (!(m.rawData[0] & FIRST_FRAME_MARKER_MASK)) return false;
+  for (unsigned int i = 1; i < LENGTH; ++i) {
+    if (m.rawData[i] & FIRST_FRAME_MARKER_MASK) return false;
+  }
+  return true;
+}
+
+// hand a transaction to setFromWire() and check what it made of it
+static void readOnce(byte const *data, unsigned int n) {
+  Wire.overReads = 0;
+  const uint8_t fed = Wire.receive(data, n);
+  DashMessage m;
+  m.setFromWire(Wire);
+  const unsigned int used = fed - Wire.available();
+
+  CHECK(Wire.overReads == 0, "read %lu past the end of %u bytes", Wire.overReads, fed);
+  CHECK(used <= LENGTH, "used %u bytes", used);
+  if (!m.isError()) {
+    CHECK(wellFramed(m), "accepted a badly framed message %s", m.binaryString().c_str());
+    CHECK(used == LENGTH, "accepted a message from %u bytes", used);
+    for (unsigned int i = 0; i < LENGTH; ++i) CHECK(m.rawData[i] == data[i], "byte %u isn't what was sent", i);
+  }
+}
+
+// random streams, of every length up to a bit more than the bus holds
+static void fuzzRandomStreams(unsigned long iterations) {
+  byte data[BUFFER_LENGTH + 8];
+  for (unsigned long it = 0; it < iterations; ++it) {
+    const unsigned int n = rnd(sizeof(data) + 1);
+    for (unsigned int i = 0; i < n; ++i) data[i] = randomByte();
+    readOnce(data, n);
+  }
+}
+
+// valid frames cut short are always errors, and consume nothing
+static unsigned long fuzzTruncations() {
+  unsigned long n = 0;
+  byte frame[LENGTH];
+  for (unsigned int cut = 0; cut < LENGTH; ++cut) {
+    for (unsigned int it = 0; it < 1000; ++it, ++n) {
+      randomFrame(frame);
+      Wire.receive(frame, cut);
+      DashMessage m;
+      m.setFromWire(Wire);
+      CHECK(m.isError(), "accepted %u of %u bytes", cut, LENGTH);
+      CHECK(Wire.available() == (int)cut, "consumed part of a short frame");
+      CHECK(Wire.overReads == 0, "read past a short frame");
+    }
+  }
+  return n;
+}
+
+// every single-bit flip of a valid frame.  flipping a marker bit must be caught; flipping a
+// payload bit can't be, since the protocol has no check bits -- those are counted, not failed
+static void fuzzBitFlips(unsigned long iterations, unsigned long &caught, unsigned long &undetectable) {
+  byte frame[LENGTH];
+  byte flipped[LENGTH];
+  for (unsigned long it = 0; it < iterations; ++it) {
+    randomFrame(frame);
+    for (unsigned int bit = 0; bit < LENGTH * 8; ++bit) {
+      for (unsigned int i = 0; i < LENGTH; ++i) flipped[i] = frame[i];
+      flipped[bit / 8] ^= 1 << (bit % 8);
+      readOnce(flipped, LENGTH);
+
+      Wire.receive(flipped, LENGTH);
+      DashMessage m;
+      m.setFromWire(Wire);
+      if ((1 << (bit % 8)) == FIRST_FRAME_MARKER_MASK) {
+        CHECK(m.isError(), "missed a flipped marker in byte %u", bit / 8);
+        ++caught;
+      } else {
+        CHECK(!m.isError(), "rejected a flipped payload bit");
+        ++undetectable;
+      }
+    }
+  }
+}
+
+// garbage, then a valid frame, with the stream split into transactions at random.  the
+// decoder must report exactly that frame when its last byte arrives
+static void fuzzDecoderResync(unsigned long iterations, unsigned long &worstGarbage) {
+  DashDecoder decoder;
+  byte stream[64];
+  byte frame[LENGTH];
+
+  for (unsigned long it = 0; it < iterations; ++it) {
+    const unsigned int garbage = rnd(sizeof(stream) - LENGTH);
+    for (unsigned int i = 0; i < garbage; ++i) stream[i] = randomByte();
+    randomFrame(frame);
+    for (unsigned int i = 0; i < LENGTH; ++i) stream[garbage + i] = frame[i];
+    const unsigned int n = garbage + LENGTH;
+
+    // the decoder carries on from wherever the last stream left it, as it would on the board
+    unsigned int i = 0;
+    bool found = false;
+    while (i < n) {
+      const unsigned int chunk = 1 + rnd(BUFFER_LENGTH);
+      const uint8_t fed = Wire.receive(stream + i, n - i < chunk ? n - i : chunk);
+      Wire.overReads = 0;
+      while (Wire.available()) {
+        const unsigned int at = i++;
+        const DashDecoder::Event e = decoder.push(Wire.read());
+        CHECK(decoder.filled < LENGTH, "partial frame overran: %u", decoder.filled);
+        if (e == DashDecoder::Event::frame) {
+          CHECK(wellFramed(decoder.message), "decoded a badly framed message");
+          if (at == n - 1) found = true;
+        }
+      }
+      CHECK(Wire.overReads == 0, "decoder loop read past %u bytes", fed);
+    }
+    CHECK(found, "no frame after %u bytes of garbage (iteration %lu)", garbage, it);
+    if (found) {
+      for (unsigned int j = 0; j < LENGTH; ++j) CHECK(decoder.message.rawData[j] == frame[j], "frame byte %u wrong", j);
+      if (garbage > worstGarbage) worstGarbage = garbage;
+    }
+  }
+}
+
+// a stream of frames, each stride bytes apart, with a stray byte put in at one place
+typedef struct GlitchedStream {
+  byte sent[8 * (WIRE_PROTOCOL_MAX_LENGTH + 1)]; // the frames as they were sent
+  byte stream[8 * (WIRE_PROTOCOL_MAX_LENGTH + 1) + 1]; // and as they arrived
+  unsigned int frames;
+  unsigned int stride;
+  unsigned int stray; // where the stray byte is in the stream
+
+  // where a sent byte ended up in the stream
+  unsigned int arrivedAt(unsigned int i) const { return i + (i >= stray ? 1 : 0); }
+
+  // whether a message, read with its last byte at the given place in the stream, is the
+  // frame that was sent there.  a made-up frame that happens to match some other frame
+  // doesn't count
+  bool isSent(DashMessage const &m, unsigned int last, unsigned int &frame) const {
+    for (unsigned int f = 0; f < frames; ++f) {
+      if (arrivedAt(f * stride + LENGTH - 1) != last) continue;
+      for (unsigned int i = 0; i < LENGTH; ++i) {
+        if (m.rawData[i] != sent[f * stride + i]) return false;
+      }
+      frame = f;
+      return true;
+    }
+    return false;
+  }
+} GlitchedStream;
+
+// copy the sent frames into the stream, with a stray byte somewhere in the first frame
+static void glitch(GlitchedStream &g) {
+  g.stray = rnd(g.stride + 1);
+  const unsigned int n = g.frames * g.stride;
+  for (unsigned int i = 0; i < n; ++i) g.stream[g.arrivedAt(i)] = g.sent[i];
+  g.stream[g.stray] = randomByte();
+}
+
+// a clean stream of frames with one glitch: how many good frames does each reader lose, and
+// how many frames does it make up?  setFromWire() is given the bytes a frame's length at a
+// time, as if each were a transaction of the bus buffer.  a frame only counts if every byte
+// matches what was sent.  the decoder must lose only the frame the glitch landed in
+typedef struct Recovery {
+  unsigned long lost;  // frames sent that weren't decoded as sent
+  unsigned long wrong; // frames decoded that weren't sent
+} Recovery;
+
+static void compareRecovery(unsigned long iterations, Recovery &wire, Recovery &decoded) {
+  GlitchedStream g;
+  g.frames = 8;
+  g.stride = LENGTH;
+  for (unsigned long it = 0; it < iterations; ++it) {
+    for (unsigned int f = 0; f < g.frames; ++f) randomFrame(g.sent + f * g.stride);
+    glitch(g);
+    const unsigned int n = g.frames * g.stride + 1;
+    unsigned int frame;
+
+    // the whole stream arrives as one transaction
+    unsigned int wireGood = 0;
+    Wire.receive(g.stream, n);
+    while (Wire.available() >= (int)LENGTH) {
+      DashMessage m;
+      m.setFromWire(Wire);
+      if (m.isError()) continue;
+      if (g.isSent(m, n - Wire.available() - 1, frame)) ++wireGood; else ++wire.wrong;
+    }
+
+    DashDecoder decoder;
+    unsigned int decoderGood = 0;
+    for (unsigned int i = 0; i < n; ++i) {
+      if (decoder.push(g.stream[i]) != DashDecoder::Event::frame) continue;
+      if (g.isSent(decoder.message, i, frame)) ++decoderGood; else ++decoded.wrong;
+    }
+    CHECK(decoderGood >= g.frames - 1, "decoder lost %u frames to one stray byte", g.frames - decoderGood);
+    wire.lost += g.frames - wireGood;
+    decoded.lost += g.frames - decoderGood;
+  }
+}
+
+// the same, with numbered frames: each frame is followed by its sequence number, as a
+// numbered sender's are.  after the glitch, every frame must be decoded as sent, and then
+// its own sequence number
+static void fuzzNumberedFrames(unsigned long iterations, Recovery &decoded, unsigned long &sequencesLost) {
+  GlitchedStream g;
+  g.frames = 8;
+  g.stride = LENGTH + 1;
+  for (unsigned long it = 0; it < iterations; ++it) {
+    const uint8_t firstSequence = rnd(0x80);
+    for (unsigned int f = 0; f < g.frames; ++f) {
+      randomFrame(g.sent + f * g.stride);
+      g.sent[f * g.stride + LENGTH] = (firstSequence + f) & ~FIRST_FRAME_MARKER_MASK;
+    }
+    glitch(g);
+    const unsigned int n = g.frames * g.stride + 1;
+
+    DashDecoder decoder(true);
+    unsigned int good = 0, sequences = 0;
+    unsigned int frame = 0;
+    bool matched = false; // whether the last byte completed a frame that was sent
+    for (unsigned int i = 0; i < n; ++i) {
+      const DashDecoder::Event e = decoder.push(g.stream[i]);
+      if (e == DashDecoder::Event::frame) {
+        matched = g.isSent(decoder.message, i, frame);
+        if (matched) ++good; else ++decoded.wrong;
+        continue;
+      }
+      if (e == DashDecoder::Event::sequence) {
+        CHECK(!(decoder.lastSequence & FIRST_FRAME_MARKER_MASK), "sequence number %u has the marker", decoder.lastSequence);
+        if (matched && g.arrivedAt(frame * g.stride + LENGTH) == i && decoder.lastSequence == g.sent[frame * g.stride + LENGTH]) ++sequences;
+      }
+      matched = false;
+    }
+    CHECK(good >= g.frames - 1, "decoder lost %u numbered frames to one stray byte", g.frames - good);
+    CHECK(sequences >= g.frames - 1, "decoder lost %u sequence numbers to one stray byte", g.frames - sequences);
+    decoded.lost += g.frames - good;
+    sequencesLost += g.frames - sequences;
+  }
+}
+
+int main(int argc, char **argv) {
+  const unsigned long iterations = argc > 1 ? strtoul(argv[1], 0, 10) : 200000;
+  const uint32_t seed = argc > 2 ? strtoul(argv[2], 0, 10) : 0x5EED;
+  rngState = seed ? seed : 1;
+  printf("fuzzing a %u-byte DashMessage, %lu iterations, seed %lu\n", LENGTH, iterations, (unsigned long)seed);
+
+  fuzzRandomStreams(iterations);
+  printf("  random streams:   %lu\n", iterations);
+
+  const unsigned long truncations = fuzzTruncations();
+  printf("  truncations:      %lu, all rejected\n", truncations);
+
+  unsigned long caught = 0, undetectable = 0;
+  fuzzBitFlips(iterations / 10, caught, undetectable);
+  printf("  bit flips:        %lu marker flips caught, %lu payload flips undetectable (no check bits)\n", caught, undetectable);
+
+  unsigned long worstGarbage = 0;
+  fuzzDecoderResync(iterations, worstGarbage);
+  printf("  decoder resyncs:  %lu, each at the next frame (up to %lu garbage bytes)\n", iterations, worstGarbage);
+
+  const double runs = iterations / 10;
+  Recovery wire = { 0, 0 }, decoded = { 0, 0 };
+  compareRecovery(iterations / 10, wire, decoded);
+  printf("  one stray byte:   setFromWire lost %.2f of 8 frames and made up %.2f, the decoder lost %.2f and made up %.2f\n",
+    wire.lost / runs, wire.wrong / runs, decoded.lost / runs, decoded.wrong / runs);
+
+  Recovery numbered = { 0, 0 };
+  unsigned long sequencesLost = 0;
+  fuzzNumberedFrames(iterations / 10, numbered, sequencesLost);
+  printf("  numbered frames:  the decoder lost %.2f of 8 frames, made up %.2f, and lost %.2f sequence numbers\n",
+    numbered.lost / runs, numbered.wrong / runs, (double)sequencesLost / runs);
+
+  if (failures) {
+    printf("%lu FAILURES\n", failures);
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
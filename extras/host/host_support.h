@@ -0,0 +1,21 @@
+#pragma once
+
+// The dash's hardware support for programs on the host: the pins are the shim's pretend
+// ones, and the strip and servos are the fakes the unit tests use
+
+#define ARDUINO_CI_COMPILATION_MOCKS // the fake FastLED and servos
+#include <Arduino.h>
+#include <Wire.h>
+#include "DashState.h"
+
+int hostPins[32];
+unsigned long hostMillis;
+TwoWire Wire;
+CFastLED FastLED;
+
+void hostPinMode(pin_size_t, int) {}
+int hostAnalogRead(unsigned char pin) { return analogRead(pin); }
+int hostDigitalRead(unsigned char pin) { return digitalRead(pin); }
+void hostDigitalWrite(pin_size_t pin, int val) { digitalWrite(pin, val); }
+
+DashSupport hostSupport = { hostPinMode, hostAnalogRead, hostDigitalRead, hostDigitalWrite, &FastLED };
@@ -0,0 +1,69 @@
+// Plays a capture back into a DashState as fast as it will go, to reproduce what the dash
+// did on a drive, and to time apply() over real data.
+//
+// usage: replay_capture <capture file> [ms between trace lines]
+//
+// with a trace interval, the dash's state is printed at that interval of capture time
+
+#include "host_support.h"
+#include "DashCapture.h"
+
+#include <chrono>
+#include <stdlib.h>
+#include <vector>
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <capture file> [ms between trace lines]\n", argv[0]);
+    return 2;
+  }
+  const unsigned long traceMs = argc > 2 ? strtoul(argv[2], 0, 10) : 0;
+
+  FILE *f = fopen(argv[1], "rb");
+  if (!f) {
+    perror(argv[1]);
+    return 2;
+  }
+  std::vector<byte> capture;
+  byte chunk[65536];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) capture.insert(capture.end(), chunk, chunk + n);
+  fclose(f);
+
+  DashCaptureReader reader(capture.data(), capture.size());
+  if (!reader.begin()) {
+    fprintf(stderr, "%s: not a capture of a %u-byte DashMessage\n", argv[1], DashMessage::length);
+    return 1;
+  }
+
+  DashState dash(hostSupport);
+  dash.setup();
+
+  unsigned long records = 0;
+  unsigned long applies = 0;
+  unsigned long firstTime = 0;
+  unsigned long nextTrace = 0;
+  const auto start = std::chrono::steady_clock::now();
+  while (reader.next()) {
+    if (!records++) {
+      firstTime = reader.time;
+      nextTrace = reader.time;
+    }
+    if (!reader.replay(dash)) continue;
+    ++applies;
+    if (traceMs && (long)(reader.time - nextTrace) >= 0) {
+      printf("%10lu %s\n", reader.time, dash.lastState.toString().c_str());
+      nextTrace += traceMs;
+    }
+  }
+  const auto end = std::chrono::steady_clock::now();
+
+  if (reader.error) fprintf(stderr, "%s: malformed at byte %lu; replayed what came before\n", argv[1], reader.position);
+
+  const double wall = std::chrono::duration<double>(end - start).count();
+  const double driven = (reader.time - firstTime) / 1000.0;
+  printf("%lu bytes, %lu records, %lu applies over %.1f s of capture\n", (unsigned long)capture.size(), records, applies, driven);
+  printf("replayed in %.3f s: %.0f ns per apply, %.0fx real time\n", wall, wall * 1e9 / (applies ? applies : 1), driven / wall);
+  printf("shows %lu, strip %s\n", FastLED.numShows, dash.renderer.toString().c_str());
+  return reader.error ? 1 : 0;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+// Just enough of the Arduino core to compile the library headers natively.  Nothing here
+// touches hardware: pins read as whatever the harness puts in hostPins, millis() is whatever
+// it puts in hostMillis, and interrupts are a no-op since there's only ever one thread.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+typedef uint8_t byte;
+typedef uint8_t pin_size_t;
+#define pin_size_t pin_size_t // so the library headers see that it already exists
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+#define LED_BUILTIN 13
+
+enum { A0 = 14, A1, A2, A3, A4, A5, A6, A7 };
+
+// the pretend pins, and the pretend clock
+extern int hostPins[32];
+extern unsigned long hostMillis;
+
+inline unsigned long millis() { return hostMillis; }
+
+inline int digitalRead(pin_size_t pin) { return hostPins[pin & 31] ? HIGH : LOW; }
+inline int analogRead(pin_size_t pin) { return hostPins[pin & 31]; }
+inline void digitalWrite(pin_size_t pin, int val) { hostPins[pin & 31] = val; }
+inline void pinMode(pin_size_t, uint8_t) {}
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+inline long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+class String {
+  std::string s;
+public:
+  String() {}
+  String(const char *c) : s(c) {}
+  String(std::string const &c) : s(c) {}
+  void concat(const char *c) { s += c; }
+  void concat(String const &o) { s += o.s; }
+  String operator+(String const &o) const { return String(s + o.s); }
+  bool operator==(String const &o) const { return s == o.s; }
+  bool operator!=(String const &o) const { return s != o.s; }
+  unsigned int length() const { return s.size(); }
+  const char *c_str() const { return s.c_str(); }
+};
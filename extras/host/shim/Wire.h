@@ -0,0 +1,55 @@
+#pragma once
+
+// A TwoWire that the harness fills and empties by hand.  It keeps the real library's
+// 32-byte buffers, and read() returns -1 when there's nothing left -- but here that's
+// also counted, because a reader that goes past available() is reading garbage on the board.
+
+#include "Arduino.h"
+
+#define BUFFER_LENGTH 32
+
+class TwoWire {
+public:
+  uint8_t rx[BUFFER_LENGTH];
+  uint8_t rxLength;
+  uint8_t rxIndex;
+  unsigned long overReads;  // read() calls with nothing available
+
+  uint8_t tx[BUFFER_LENGTH];
+  uint8_t txLength;
+  uint8_t txStatus;         // what endTransmission() returns
+
+  TwoWire() : rxLength(0), rxIndex(0), overReads(0), txLength(0), txStatus(0) {}
+
+  // the harness side: what the next onReceive() will find.  returns how much fit
+  uint8_t receive(const uint8_t *data, unsigned int n) {
+    rxLength = n > BUFFER_LENGTH ? BUFFER_LENGTH : n;
+    for (uint8_t i = 0; i < rxLength; ++i) rx[i] = data[i];
+    rxIndex = 0;
+    return rxLength;
+  }
+
+  // the library side
+  void begin() {}
+  void begin(uint8_t) {}
+  void onReceive(void (*)(int)) {}
+
+  int available() { return rxLength - rxIndex; }
+  int read() {
+    if (rxIndex >= rxLength) {
+      ++overReads;
+      return -1;
+    }
+    return rx[rxIndex++];
+  }
+
+  void beginTransmission(uint8_t) { txLength = 0; }
+  size_t write(uint8_t b) {
+    if (txLength >= BUFFER_LENGTH) return 0;
+    tx[txLength++] = b;
+    return 1;
+  }
+  uint8_t endTransmission() { return txStatus; }
+};
+
+extern TwoWire Wire;
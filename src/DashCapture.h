@@ -0,0 +1,268 @@
+#pragma once
+
+#include <Arduino.h>
+#include "DashMessage.h"
+#include "SlaveProperties.h"
+
+/*
+
+Recording what the slave saw, so that it can be played back
+
+A capture is everything that went into the slave's apply() calls: the master's message,
+the slave's own input pins, and when each apply() happened.  Played back into a DashState,
+it reproduces what the dash did on the road -- on the bench, as fast as the host can go.
+
+The format is a header, then a stream of records:
+
+  header:  'M' 'D' 'C' <version> <message length>
+
+  record:  kk tttttt  [ time ]  [ payload ]
+           |  |
+           |  +-- ms since the previous record (the first, since the board started); 63 means the
+           |      time follows, 7 bits per byte, lowest first, the top bit set on all but the last
+           +----- the kind of record
+
+  kinds:   message (0)  the message the dash acted on from here on: the message's bytes
+           sample  (1)  the slave's input pins, then an apply(): a byte of flags (ignition,
+                        backlightDim, tachometerWarning, tachometerCritical, lowest bit
+                        first), then the fuel, temperature, and oil levels, 10 bits each,
+                        packed lowest first into 4 bytes
+           apply   (2)  an apply() with the same pins as the last sample
+
+The slave's loop runs every few ms and its pins rarely change, so most loops cost a
+single byte.  Messages are only recorded when they change.
+*/
+
+const byte DASH_CAPTURE_MAGIC[3] = { 'M', 'D', 'C' };
+const uint8_t DASH_CAPTURE_VERSION = 1;
+const unsigned int DASH_CAPTURE_HEADER_LENGTH = 5;
+const unsigned int DASH_CAPTURE_SAMPLE_LENGTH = 5;
+
+namespace DashCaptureRecord {
+  enum Values : uint8_t {
+    message = 0,
+    sample  = 1,
+    apply   = 2,
+  };
+}
+
+const byte DASH_CAPTURE_TIME_MASK = 0b00111111; // the tag's share of the time
+const byte DASH_CAPTURE_TIME_FOLLOWS = DASH_CAPTURE_TIME_MASK; // and the value that means "it's too big, see next bytes"
+const unsigned int DASH_CAPTURE_LEVEL_MAX = 1023; // the analog levels are what analogRead() gives
+
+// The writing of a capture, as the slave's loop runs.  The sink is anything with a
+// write(uint8_t) -- Serial, on the board
+template <typename Sink>
+struct DashCaptureWriter {
+  Sink &sink;
+  unsigned long lastTime;    // the time of the last record
+  DashMessage lastMessage;   // the last message recorded
+  SlaveState lastSample;     // the last pins recorded
+  bool hasMessage;           // whether a message has been recorded yet
+  bool hasSample;            // whether a sample has been recorded yet
+
+  unsigned long records;     // records written
+  unsigned long bytes;       // bytes written, including the header
+
+  DashCaptureWriter(Sink &s) : sink(s) { reset(); }
+
+  // forget what's been recorded, without writing anything
+  void reset() {
+    lastTime = 0;
+    hasMessage = false;
+    hasSample = false;
+    records = 0;
+    bytes = 0;
+  }
+
+  // start a capture: write the header
+  void begin() {
+    reset();
+    for (unsigned int i = 0; i < sizeof(DASH_CAPTURE_MAGIC); ++i) put(DASH_CAPTURE_MAGIC[i]);
+    put(DASH_CAPTURE_VERSION);
+    put(DashMessage::length);
+  }
+
+  // the message the dash will act on from here on, if it's changed
+  void message(DashMessage const &m, unsigned long const &millis) {
+    if (hasMessage && m == lastMessage) return;
+    tag(DashCaptureRecord::Values::message, millis);
+    for (unsigned int i = 0; i < DashMessage::length; ++i) put(m.rawData[i]);
+    lastMessage = m;
+    hasMessage = true;
+  }
+
+  // the slave's pins, and an apply() at the given time
+  void sample(SlaveState const &s, unsigned long const &millis) {
+    if (hasSample && sameInputs(s, lastSample)) {
+      tag(DashCaptureRecord::Values::apply, millis);
+      return;
+    }
+    tag(DashCaptureRecord::Values::sample, millis);
+    put((s.ignition           ? 0b0001 : 0) |
+        (s.backlightDim       ? 0b0010 : 0) |
+        (s.tachometerWarning  ? 0b0100 : 0) |
+        (s.tachometerCritical ? 0b1000 : 0));
+    const uint32_t levels = (uint32_t)level(s.fuelLevel)
+                          | (uint32_t)level(s.temperatureLevel) << 10
+                          | (uint32_t)level(s.oilPressureLevel) << 20;
+    for (unsigned int i = 0; i < 4; ++i) put(levels >> (8 * i));
+    lastSample = s;
+    hasSample = true;
+  }
+
+  // one pass of the slave's loop: the sample the dash was given, its message included.  that's
+  // the dash's state() after apply(), not its lastState, which has been debounced
+  inline void record(SlaveState const &given, unsigned long const &millis) {
+    message(given.masterMessage, millis);
+    sample(given, millis);
+  }
+
+  // whether two states read the same from the pins
+  static bool sameInputs(SlaveState const &a, SlaveState const &b) {
+    return a.ignition == b.ignition && a.backlightDim == b.backlightDim
+      && a.tachometerWarning == b.tachometerWarning && a.tachometerCritical == b.tachometerCritical
+      && level(a.fuelLevel) == level(b.fuelLevel) && level(a.temperatureLevel) == level(b.temperatureLevel)
+      && level(a.oilPressureLevel) == level(b.oilPressureLevel);
+  }
+
+  // an analog level, as it fits in a sample
+  static inline uint16_t level(int16_t v) {
+    return v < 0 ? 0 : (v > (int16_t)DASH_CAPTURE_LEVEL_MAX ? DASH_CAPTURE_LEVEL_MAX : v);
+  }
+
+  // summary of the recording
+  String toString() const {
+    char ret[32];
+    sprintf(ret, "cap %lu/%lu", records, bytes);
+    return String(ret);
+  }
+
+private:
+  inline void put(byte b) {
+    sink.write((uint8_t)b);
+    ++bytes;
+  }
+
+  void tag(DashCaptureRecord::Values kind, unsigned long const &millis) {
+    unsigned long dt = millis - lastTime;
+    lastTime = millis;
+    ++records;
+    if (dt < DASH_CAPTURE_TIME_FOLLOWS) {
+      put((kind << 6) | dt);
+      return;
+    }
+    put((kind << 6) | DASH_CAPTURE_TIME_FOLLOWS);
+    while (dt > 0x7F) {
+      put(0x80 | (dt & 0x7F));
+      dt >>= 7;
+    }
+    put(dt);
+  }
+};
+
+// The reading of a capture that's in memory, a record at a time
+typedef struct DashCaptureReader {
+  const byte *data;          // the capture
+  unsigned long length;      // its size
+  unsigned long position;    // where the next record starts
+  bool error;                // whether the capture was found to be malformed
+
+  DashCaptureRecord::Values kind; // the kind of the last record read
+  unsigned long time;        // when it happened, by the board's millis()
+  DashMessage message;       // the last message read
+  SlaveState sample;         // the last pins read
+
+  DashCaptureReader(const byte *d, unsigned long len) : data(d), length(len) { reset(); }
+
+  // go back to the start
+  void reset() {
+    position = 0;
+    error = false;
+    kind = DashCaptureRecord::Values::apply;
+    time = 0;
+    message = DashMessage();
+    sample = SlaveState();
+  }
+
+  // check the header, and move past it.  returns whether it's a capture we can read
+  bool begin() {
+    reset();
+    error = length < DASH_CAPTURE_HEADER_LENGTH
+      || data[0] != DASH_CAPTURE_MAGIC[0] || data[1] != DASH_CAPTURE_MAGIC[1] || data[2] != DASH_CAPTURE_MAGIC[2]
+      || data[3] != DASH_CAPTURE_VERSION
+      || data[4] != DashMessage::length;
+    if (!error) position = DASH_CAPTURE_HEADER_LENGTH;
+    return !error;
+  }
+
+  // read the next record.  returns false at the end of the capture, or if it's malformed
+  bool next() {
+    if (error || position >= length) return false;
+
+    const byte tag = data[position++];
+    unsigned long dt = tag & DASH_CAPTURE_TIME_MASK;
+    if (dt == DASH_CAPTURE_TIME_FOLLOWS) {
+      dt = 0;
+      for (unsigned int shift = 0; ; shift += 7) {
+        if (position >= length || shift > 28) return fail();
+        const byte b = data[position++];
+        dt |= (unsigned long)(b & 0x7F) << shift;
+        if (!(b & 0x80)) break;
+      }
+    }
+
+    switch (tag >> 6) {
+      case DashCaptureRecord::Values::message:
+        if (length - position < DashMessage::length) return fail();
+        for (unsigned int i = 0; i < DashMessage::length; ++i) message.setRawByte(i, data[position++]);
+        break;
+      case DashCaptureRecord::Values::sample: {
+        if (length - position < DASH_CAPTURE_SAMPLE_LENGTH) return fail();
+        const byte flags = data[position++];
+        uint32_t levels = 0;
+        for (unsigned int i = 0; i < 4; ++i) levels |= (uint32_t)data[position++] << (8 * i);
+        sample.ignition           = flags & 0b0001;
+        sample.backlightDim       = flags & 0b0010;
+        sample.tachometerWarning  = flags & 0b0100;
+        sample.tachometerCritical = flags & 0b1000;
+        sample.fuelLevel          = levels & DASH_CAPTURE_LEVEL_MAX;
+        sample.temperatureLevel   = (levels >> 10) & DASH_CAPTURE_LEVEL_MAX;
+        sample.oilPressureLevel   = (levels >> 20) & DASH_CAPTURE_LEVEL_MAX;
+        break;
+      }
+      case DashCaptureRecord::Values::apply:
+        break;
+      default:
+        return fail();
+    }
+
+    kind = (DashCaptureRecord::Values)(tag >> 6);
+    time += dt;
+    return true;
+  }
+
+  // play the last record into a dash: a message is set, and a sample or an apply ends in
+  // an apply().  returns whether the dash was applied
+  template <typename Dash>
+  bool replay(Dash &dash) const {
+    switch (kind) {
+      case DashCaptureRecord::Values::message:
+        dash.setMessage(message);
+        return false;
+      case DashCaptureRecord::Values::sample:
+        dash.state().setInputs(sample);
+        dash.apply(time);
+        return true;
+      default:
+        dash.apply(time);
+        return true;
+    }
+  }
+
+private:
+  bool fail() {
+    error = true;
+    return false;
+  }
+} DashCaptureReader;
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <Arduino.h>
+#include "DashMessage.h"
+
+// The hand-off of DashMessages from the I2C receiver to the main loop.
+//
+// The receiver runs in interrupt context, and it can fire in the middle of the main
+// loop's copy of a message -- leaving the loop with half of an old message and half
+// of a new one.  So the receiver posts each message here, and the main loop takes the
+// latest one when it's ready for it.  Only the latest message matters (each one is a
+// complete picture of the master's inputs), so there's a single slot rather than a queue.
+//
+// This is a sequence lock: the producer bumps the sequence number before and after it
+// writes, so the sequence is odd while a write is underway.  The consumer reads the
+// sequence, copies the slot, and reads the sequence again; if it was odd or it moved,
+// the copy may be torn, so it tries again.  The producer never waits on anything, so the
+// interrupt handler stays short.  This relies on there being exactly one producer (the
+// interrupt handler) and one consumer (the main loop), and on the producer never being
+// interrupted by the consumer -- which is how interrupts work on a single-core board.
+//
+// Everything the two sides share is volatile, so the compiler keeps the accesses in order.
+// The sequence is a single byte so that it's read in one instruction on an 8-bit AVR.
+
+// What the mailbox has seen, for diagnostics
+typedef struct MailboxCounts {
+  unsigned long posted;      // messages handed to the mailbox
+  unsigned long overwritten; // messages replaced by a newer one before they were taken
+  unsigned long dropped;     // messages the producer rejected (e.g. bad framing)
+} MailboxCounts;
+
+typedef struct DashMailbox {
+  volatile uint8_t sequence;                         // odd while the producer is writing
+  volatile uint8_t serial;                           // bumped for every posted message
+  volatile uint8_t takenSerial;                      // the serial of the last message taken (consumer-owned)
+  volatile byte rawData[WIRE_PROTOCOL_MESSAGE_LENGTH]; // the latest message
+  volatile unsigned long posted;
+  volatile unsigned long overwritten;
+  volatile unsigned long dropped;
+
+  DashMailbox() { reset(); }
+
+  // forget everything.  not safe to call while the producer may be running
+  void reset() {
+    sequence = 0;
+    serial = 0;
+    takenSerial = 0;
+    for (unsigned int i = 0; i < WIRE_PROTOCOL_MESSAGE_LENGTH; ++i) rawData[i] = 0;
+    posted = 0;
+    overwritten = 0;
+    dropped = 0;
+  }
+
+  // PRODUCER: store a message, replacing whatever is there
+  void post(DashMessage const &m) {
+    ++sequence;
+    for (unsigned int i = 0; i < WIRE_PROTOCOL_MESSAGE_LENGTH; ++i) rawData[i] = m.rawData[i];
+    if (serial != takenSerial) ++overwritten; // the previous one was never taken
+    ++serial;
+    ++posted;
+    ++sequence;
+  }
+
+  // PRODUCER: count a message that was received but not worth posting
+  void drop() {
+    ++sequence;
+    ++dropped;
+    ++sequence;
+  }
+
+  // CONSUMER: copy out the latest message if it's one we haven't taken yet.
+  // returns whether the message was new
+  bool take(DashMessage &m) {
+    const uint8_t previous = takenSerial;
+    uint8_t before;
+    uint8_t latest;
+    do {
+      before = sequence;
+      latest = serial;
+      for (unsigned int i = 0; i < WIRE_PROTOCOL_MESSAGE_LENGTH; ++i) m.rawData[i] = rawData[i];
+      // mark it taken before checking the sequence, so a post that lands after
+      // the check can't count this message as overwritten
+      takenSerial = latest;
+    } while ((before & 1) || before != sequence);
+
+    return latest != previous;
+  }
+
+  // CONSUMER: a consistent copy of the counters
+  MailboxCounts counts() const {
+    MailboxCounts ret;
+    uint8_t before;
+    do {
+      before = sequence;
+      ret.posted      = posted;
+      ret.overwritten = overwritten;
+      ret.dropped     = dropped;
+    } while ((before & 1) || before != sequence);
+    return ret;
+  }
+
+  // CONSUMER: summary of the counters
+  String toString() const {
+    const MailboxCounts c = counts();
+    char ret[40];
+    sprintf(ret, "msg %lu %lu %lu", c.posted, c.overwritten, c.dropped);
+    return String(ret);
+  }
+
+} DashMailbox;
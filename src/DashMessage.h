@@ -3,6 +3,7 @@
 #include <Arduino.h>
 #include <Wire.h>
 #include "MasterProperties.h"
+#include "PortSnapshot.h"
 
 const uint8_t SLAVE_I2C_ADDRESS = 9;
 
@@ -10,6 +11,10 @@ const uint8_t SLAVE_I2C_ADDRESS = 9;
   using pin_size_t = uint8_t;
 #endif
 
+// the widest an unsigned long gets in decimal on a 32-bit board.  the statistics summaries
+// are sized from this, so that no count is ever cut short
+const unsigned int ULONG_TEXT_DIGITS = 10;
+
 /*
 
 Defining a wire protocol here
@@ -26,46 +31,108 @@ The receiver will discard bytes until it finds one with the
 leading '1', then begin its normal processing
 */
 
-// the number of bytes needed for our contrived protocol
-const unsigned int WIRE_PROTOCOL_MESSAGE_LENGTH = 2;
+// the number of bytes needed to carry some number of payload bits, 7 per byte
+constexpr unsigned int wireProtocolLength(unsigned int payloadBits) {
+  return (payloadBits + 6) / 7;
+}
+
+// the most bytes we can send in one go: the size of the Wire library's buffer
+const unsigned int WIRE_PROTOCOL_MAX_LENGTH = 32;
 
 
 // the way that we will indicate the first byte in the protocol sequence
 const byte FIRST_FRAME_MARKER_MASK = 0b10000000;
 
 
+// The packing of a multi-bit field into one byte of the payload, and then into the next
+// byte, until the field runs out.  Each byte's share of the field is a fixed mask and a
+// pair of fixed shifts, so a field access unrolls into a few loads, shifts, and masks
+// rather than a loop over the bits
+template <typename Field, unsigned int Byte, bool InField = (Byte * 7 < Field::end)>
+struct DashFieldBytes {
+  static const unsigned int first   = Byte * 7 > Field::position ? Byte * 7 : Field::position; // the field's first payload bit in this byte
+  static const unsigned int last    = Byte * 7 + 7 < Field::end ? Byte * 7 + 7 : Field::end;  // and one past its last
+  static const unsigned int inByte  = first - Byte * 7;         // where that part of the field sits in the byte
+  static const unsigned int inValue = first - Field::position;  // and in the value
+  static const byte mask = (byte)(((1u << (last - first)) - 1) << inByte);
+
+  static inline uint16_t get(byte const *rawData) {
+    return ((uint16_t)((rawData[Byte] & mask) >> inByte) << inValue) | DashFieldBytes<Field, Byte + 1>::get(rawData);
+  }
+
+  static inline void set(byte *rawData, uint16_t value) {
+    rawData[Byte] = (rawData[Byte] & ~mask) | ((byte)((value >> inValue) << inByte) & mask);
+    DashFieldBytes<Field, Byte + 1>::set(rawData, value);
+  }
+};
+
+// past the end of the field: nothing left to pack
+template <typename Field, unsigned int Byte>
+struct DashFieldBytes<Field, Byte, false> {
+  static inline uint16_t get(byte const *) { return 0; }
+  static inline void set(byte *, uint16_t) {}
+};
+
+
 /**
 
   This struct defines all the bit accesses, creation, reading,
   and sending for our protocol.
 
  */
-typedef struct DashMessage {
-  byte rawData[WIRE_PROTOCOL_MESSAGE_LENGTH]; // the underlying data
+template <unsigned int PayloadBits>
+struct DashMessageOf {
+  // the length of the message, worked out from the number of payload bits
+  static const unsigned int length = wireProtocolLength(PayloadBits);
+  static_assert(length <= WIRE_PROTOCOL_MAX_LENGTH, "Too many signals: the message no longer fits in one I2C transmission");
+
+
+  byte rawData[length]; // the underlying data
 
   // get the maximum amount of bits we can carry based on our length
   inline unsigned int maxBitPosition() const {
-    return WIRE_PROTOCOL_MESSAGE_LENGTH * 7;
+    return length * 7;
   }
 
+  // which byte a signal is in, and its bit within that byte.  The positions are constants
+  // at nearly every call site, so these are worked out at compile time and a bit access
+  // comes down to a single load and mask
+  static constexpr unsigned int byteOf(unsigned int position) { return position / 7; }
+  static constexpr byte maskOf(unsigned int position) { return 0b00000001 << (position % 7); }
+
   // extract a single bit
   inline bool getBit(MasterSignal::Values position) const {
-    return rawData[position / 7] & (0b00000001 << position % 7);
+    return rawData[byteOf(position)] & maskOf(position);
   }
 
   // set a single bit
   inline void setBit(MasterSignal::Values position, bool val) {
-    const byte mask = 0b00000001 << (position % 7);
     if (val)
-      rawData[position / 7] |= mask;
+      rawData[byteOf(position)] |= maskOf(position);
     else
-      rawData[position / 7] &= ~mask;
+      rawData[byteOf(position)] &= ~maskOf(position);
+  }
+
+  // extract a multi-bit field
+  template <typename Field>
+  inline uint16_t getField() const {
+    static_assert(Field::end <= length * 7, "The field doesn't fit in this message");
+    return DashFieldBytes<Field, Field::position / 7>::get(rawData);
   }
 
-  // make a binary representation of what's in the message
+  // set a multi-bit field.  a value too big for the field is set to its largest
+  template <typename Field>
+  inline void setField(uint16_t val) {
+    static_assert(Field::end <= length * 7, "The field doesn't fit in this message");
+    DashFieldBytes<Field, Field::position / 7>::set(rawData, val > Field::maxValue ? Field::maxValue : val);
+  }
+
+  // make a binary representation of what's in the message, highest position first
   String binaryString() const {
     String ret = "0b";
-    for (int i = maxBitPosition() - 1; i >= 0; --i) ret.concat(getBit((MasterSignal::Values)i) ? "1" : "0");
+    for (int i = length - 1; i >= 0; --i) {
+      for (byte mask = maskOf(6); mask; mask >>= 1) ret.concat((rawData[i] & mask) ? "1" : "0");
+    }
     return ret;
   }
 
@@ -81,12 +148,12 @@ typedef struct DashMessage {
 
   // set a message unconditionally
   inline void setRawBytes(byte* data) {
-    for (unsigned int i = 0; i < WIRE_PROTOCOL_MESSAGE_LENGTH; ++i) setRawByte(i, data[i]);
+    for (unsigned int i = 0; i < length; ++i) setRawByte(i, data[i]);
   }
 
   // set a message but obey framing
   inline void setBytes(byte* data) {
-    for (unsigned int i = 0; i < WIRE_PROTOCOL_MESSAGE_LENGTH; ++i) setByte(i, data[i]);
+    for (unsigned int i = 0; i < length; ++i) setByte(i, data[i]);
   }
 
   // if frame marker is unset, this is an error
@@ -106,11 +173,12 @@ typedef struct DashMessage {
 
   // empty valid data set
   inline void initFrames() {
-    for (unsigned int i = 0; i < WIRE_PROTOCOL_MESSAGE_LENGTH; ++i) setByte(i, 0);
+    for (unsigned int i = 0; i < length; ++i) setByte(i, 0);
   }
 
   // read payload from digital input pins
-  void setFromPins(int (*myDigitalRead)(pin_size_t)) {
+  template<typename DigitalRead>
+  void setFromPins(DigitalRead myDigitalRead) {
     setBit(MasterSignal::Values::boostWarning,         myDigitalRead(MasterPin::Values::boostWarning        ));
     setBit(MasterSignal::Values::boostCritical,        myDigitalRead(MasterPin::Values::boostCritical       ));
     setBit(MasterSignal::Values::acOn,                 myDigitalRead(MasterPin::Values::acOn                ));
@@ -123,29 +191,28 @@ typedef struct DashMessage {
     setBit(MasterSignal::Values::scrollBrightness,     myDigitalRead(MasterPin::Values::scrollBrightness    ));
   }
 
-#ifdef PinStatus
-  // read payload from digital input pins
-  void setFromPins(PinStatus (*myDigitalRead)(pin_size_t)) {
-    setBit(MasterSignal::Values::boostWarning,         myDigitalRead(MasterPin::Values::boostWarning        ));
-    setBit(MasterSignal::Values::boostCritical,        myDigitalRead(MasterPin::Values::boostCritical       ));
-    setBit(MasterSignal::Values::acOn,                 myDigitalRead(MasterPin::Values::acOn                ));
-    setBit(MasterSignal::Values::heatedRearWindowOn,   myDigitalRead(MasterPin::Values::heatedRearWindowOn  ));
-    setBit(MasterSignal::Values::hazardOff,            myDigitalRead(MasterPin::Values::hazardOff           ));
-    setBit(MasterSignal::Values::rearFoggerOn,         myDigitalRead(MasterPin::Values::rearFoggerOn        ));
-    setBit(MasterSignal::Values::scrollCAN,            myDigitalRead(MasterPin::Values::scrollCAN           ));
-    setBit(MasterSignal::Values::scrollPresetColours,  myDigitalRead(MasterPin::Values::scrollPresetColours ));
-    setBit(MasterSignal::Values::scrollRainbowEffects, myDigitalRead(MasterPin::Values::scrollRainbowEffects));
-    setBit(MasterSignal::Values::scrollBrightness,     myDigitalRead(MasterPin::Values::scrollBrightness    ));
+  // read payload from a snapshot of the input ports
+  static_assert(gpioHasPin(MasterPin::Values::boostWarning) && gpioHasPin(MasterPin::Values::scrollBrightness), "A master pin isn't on a port we snapshot");
+  void setFromPorts(PortSnapshot const &ports) {
+    setBit(MasterSignal::Values::boostWarning,         ports.isHigh(MasterPin::Values::boostWarning        ));
+    setBit(MasterSignal::Values::boostCritical,        ports.isHigh(MasterPin::Values::boostCritical       ));
+    setBit(MasterSignal::Values::acOn,                 ports.isHigh(MasterPin::Values::acOn                ));
+    setBit(MasterSignal::Values::heatedRearWindowOn,   ports.isHigh(MasterPin::Values::heatedRearWindowOn  ));
+    setBit(MasterSignal::Values::hazardOff,            ports.isHigh(MasterPin::Values::hazardOff           ));
+    setBit(MasterSignal::Values::rearFoggerOn,         ports.isHigh(MasterPin::Values::rearFoggerOn        ));
+    setBit(MasterSignal::Values::scrollCAN,            ports.isHigh(MasterPin::Values::scrollCAN           ));
+    setBit(MasterSignal::Values::scrollPresetColours,  ports.isHigh(MasterPin::Values::scrollPresetColours ));
+    setBit(MasterSignal::Values::scrollRainbowEffects, ports.isHigh(MasterPin::Values::scrollRainbowEffects));
+    setBit(MasterSignal::Values::scrollBrightness,     ports.isHigh(MasterPin::Values::scrollBrightness    ));
   }
-#endif
 
   // read input from I2C
   void setFromWire(TwoWire &wire) {
-    if (wire.available() < (int)WIRE_PROTOCOL_MESSAGE_LENGTH) {
+    if (wire.available() < (int)length) {
       setError();
     } else {
       clearError();
-      for (unsigned int i = 0; i < WIRE_PROTOCOL_MESSAGE_LENGTH; ++i) {
+      for (unsigned int i = 0; i < length; ++i) {
         setRawByte(i, wire.read());
         // verify framing, return errored item if not
         if (!!i == !!(rawData[i] & FIRST_FRAME_MARKER_MASK)) {
@@ -157,48 +224,314 @@ typedef struct DashMessage {
   }
 
   // construct empty container
-  DashMessage() {
+  DashMessageOf() {
     initFrames();
   }
 
   // construct from byte array
-  DashMessage(byte* data) {
+  DashMessageOf(byte* data) {
     setBytes(data);
   }
 
   // pack an array of booleans into the raw data bytes
-  DashMessage(bool* data, unsigned int len) {
+  DashMessageOf(bool* data, unsigned int len) {
     initFrames();
-    for (unsigned int i = 0; i < (WIRE_PROTOCOL_MESSAGE_LENGTH * 7) && i < len; ++i) {
-      setBit((MasterSignal::Values)i, data[i]);
+    unsigned int i = 0;
+    for (unsigned int b = 0; b < length; ++b) {
+      for (byte mask = maskOf(0); i < len && mask < FIRST_FRAME_MARKER_MASK; mask <<= 1, ++i) {
+        if (data[i]) rawData[b] |= mask;
+      }
     }
   }
 
   // construct from arduino inputs
-  DashMessage(int (*myDigitalRead)(pin_size_t)) {
+  template<typename DigitalRead, typename = IfPinReader<DigitalRead>>
+  DashMessageOf(DigitalRead myDigitalRead) {
     initFrames();
     setFromPins(myDigitalRead);
   }
 
-#ifdef PinStatus
-  // construct from arduino inputs
-  DashMessage(PinStatus (*myDigitalRead)(pin_size_t)) {
+  // construct from a snapshot of the input ports
+  DashMessageOf(PortSnapshot const &ports) {
     initFrames();
-    setFromPins(myDigitalRead);
+    setFromPorts(ports);
   }
-#endif
 
   // construct from the wire
-  DashMessage(TwoWire wire) {
+  DashMessageOf(TwoWire wire) {
     setFromWire(wire);
   }
 
-  // send on the wire
-  void send(TwoWire &wire, int destinationAddress) {
+  // whether two messages carry the same bytes
+  inline bool operator==(DashMessageOf const &other) const {
+    for (unsigned int i = 0; i < length; ++i) {
+      if (rawData[i] != other.rawData[i]) return false;
+    }
+    return true;
+  }
+
+  inline bool operator!=(DashMessageOf const &other) const {
+    return !(*this == other);
+  }
+
+  // send on the wire.  returns the endTransmission() status: 0 for success, or why it failed
+  template <typename Bus>
+  uint8_t send(Bus &wire, int destinationAddress) const {
     wire.beginTransmission(destinationAddress);
-    for (unsigned int i = 0; i < WIRE_PROTOCOL_MESSAGE_LENGTH; ++i) wire.write((uint8_t)rawData[i]);
-    wire.endTransmission();
+    for (unsigned int i = 0; i < length; ++i) wire.write((uint8_t)rawData[i]);
+    return wire.endTransmission();
+  }
+
+  // send on the wire, followed by a sequence number.  it's 7 bits, and goes out as a
+  // continuation byte, which only a numbered DashDecoder knows to expect: to setFromWire()
+  // it's a byte too many, and an error if it's read as the start of the next message, and
+  // to an unnumbered decoder it's a loss of framing
+  template <typename Bus>
+  uint8_t send(Bus &wire, int destinationAddress, uint8_t sequence) const {
+    wire.beginTransmission(destinationAddress);
+    for (unsigned int i = 0; i < length; ++i) wire.write((uint8_t)rawData[i]);
+    wire.write((uint8_t)(sequence & ~FIRST_FRAME_MARKER_MASK));
+    return wire.endTransmission();
+  }
+
+
+};
+
+template <unsigned int PayloadBits>
+const unsigned int DashMessageOf<PayloadBits>::length;
+
+// the message that carries all of the master signals
+typedef DashMessageOf<MASTER_PAYLOAD_BITS> DashMessage;
+
+// what the slave acts on when it can no longer hear the master: every switch in the state
+// that lights nothing.  most signals are active-high, so that's a clear bit, but the hazard
+// switch reports hazardOff -- left clear, it would turn the hazard light on
+inline DashMessage failsafeDashMessage() {
+  DashMessage ret;
+  ret.setBit(MasterSignal::Values::hazardOff, true);
+  return ret;
+}
+
+// the number of bytes needed for our contrived protocol
+const unsigned int WIRE_PROTOCOL_MESSAGE_LENGTH = DashMessage::length;
+
+// the number of leading bytes that carry the MasterSignal bits
+const unsigned int WIRE_PROTOCOL_SIGNAL_BYTES = wireProtocolLength(MASTERSIGNAL_MAX + 1);
+
+
+// the shortest time between two frames from the master, in ms
+const unsigned int WIRE_PROTOCOL_MIN_GAP_MS = 5;
+
+// how often the master repeats itself when nothing has changed, in ms
+const unsigned int WIRE_PROTOCOL_HEARTBEAT_MS = 100;
+
+// the shortest time the master reports a signal as high, in ms.  a quicker press than
+// this is stretched, so the slave's debouncer never mistakes it for a bounce
+const unsigned int WIRE_PROTOCOL_MIN_PULSE_MS = 60;
+
+// The master's decision about when to send a message.
+//
+// The master samples its pins as often as it likes and hands every sample to the sender.
+// A sample that differs from the last message sent goes out right away, unless the last
+// frame went out less than minGapMs ago -- then it goes out on the first sample after the
+// gap.  When nothing changes, the last message is repeated every heartbeatMs, so the slave
+// can tell that the master is still there (and catch up if a frame was lost).
+//
+// Every sample is counted as one of: sent, skipped (nothing to send), or throttled
+// (changed, but too soon after the last frame).  Heartbeats are counted among the sent.
+//
+// A frame that the slave doesn't acknowledge is counted as a NACK, and it's sent again on
+// the first sample after the gap, whether or not anything changed; those are the retries.
+// A numbered sender follows each frame with a 7-bit sequence number, so that the slave can
+// tell how many frames it missed.  Only number the frames for a slave that reads them with
+// a numbered DashDecoder.
+typedef struct DashSender {
+  unsigned int minGapMs;       // the fastest we are allowed to send frames
+  unsigned int heartbeatMs;    // the longest we go without sending a frame
+  bool numbered;               // whether frames carry a sequence number
+  DashMessage lastSent;        // the last message that went out
+  bool hasSent;                // whether anything has been sent at all
+  bool lastFailed;             // whether the last frame went unacknowledged
+  unsigned long lastSendTime;  // when the last frame went out
+  uint8_t sequence;            // the sequence number of the next frame
+
+  unsigned long samples;         // messages handed to the sender
+  unsigned long framesSent;      // frames that went out on the wire
+  unsigned long framesSkipped;   // samples that were identical to the last frame, between heartbeats
+  unsigned long framesThrottled; // samples that changed, but arrived too soon
+  unsigned long heartbeats;      // frames that went out only because it had been a while
+  unsigned long nacks;           // frames that the slave didn't acknowledge
+  unsigned long retries;         // frames sent again because the last one failed
+
+  DashSender(unsigned int gapMs, unsigned int heartbeatIntervalMs, bool sendSequence = false) :
+    minGapMs(gapMs),
+    heartbeatMs(heartbeatIntervalMs),
+    numbered(sendSequence)
+  {
+    reset();
   }
 
+  // forget what's been sent, so that the next sample is guaranteed to go out
+  void reset() {
+    hasSent = false;
+    lastFailed = false;
+    lastSendTime = 0;
+    sequence = 0;
+    samples = 0;
+    framesSent = 0;
+    framesSkipped = 0;
+    framesThrottled = 0;
+    heartbeats = 0;
+    nacks = 0;
+    retries = 0;
+  }
+
+  // whether a sample should go out now.  Times are compared by their signed difference
+  // so that the millis() rollover is harmless
+  bool shouldSend(DashMessage const &m, unsigned long const &millis) const {
+    if (!hasSent) return true;
+    const long sinceLast = (long)(millis - lastSendTime);
+    if (lastFailed || m != lastSent) return sinceLast >= (long)minGapMs;
+    return sinceLast >= (long)heartbeatMs;
+  }
 
-} DashMessage;
+  // take a sample, and send it if it's due.  returns whether a frame was sent
+  template <typename Bus>
+  bool process(Bus &wire, int destinationAddress, DashMessage const &m, unsigned long const &millis) {
+    ++samples;
+    if (!shouldSend(m, millis)) {
+      if (lastFailed || m != lastSent) {
+        ++framesThrottled;
+      } else {
+        ++framesSkipped;
+      }
+      return false;
+    }
+
+    if (lastFailed) {
+      ++retries;
+    } else if (hasSent && m == lastSent) {
+      ++heartbeats;
+    }
+    const uint8_t status = numbered ? m.send(wire, destinationAddress, sequence) : m.send(wire, destinationAddress);
+    sequence = (sequence + 1) & ~FIRST_FRAME_MARKER_MASK;
+    lastFailed = status != 0;
+    if (lastFailed) ++nacks;
+    lastSent = m;
+    hasSent = true;
+    lastSendTime = millis;
+    ++framesSent;
+    return true;
+  }
+
+  // summary of the sending statistics
+  String toString() const {
+    char ret[sizeof("tx / hb  th  nak  re ") + 6 * ULONG_TEXT_DIGITS];
+    snprintf(ret, sizeof(ret), "tx %lu/%lu hb %lu th %lu nak %lu re %lu", framesSent, samples, heartbeats, framesThrottled, nacks, retries);
+    return String(ret);
+  }
+} DashSender;
+
+// The slave's reading of the byte stream, one byte at a time.
+//
+// setFromWire() reads a whole message's worth of bytes and gives up on the first framing
+// error, which leaves the rest of the stream misaligned -- one glitch can cost several
+// good frames.  The decoder instead looks at each byte as it arrives.  A byte with the
+// first-frame marker always starts a new frame (abandoning any partial one), and any other
+// byte either continues the frame underway or, if there isn't one, is skipped.  So after a
+// glitch it picks up again at the very next frame, and nothing valid is thrown away.
+//
+// The decoder keeps its place between calls, so a frame may be split across I2C transactions.
+//
+// A numbered decoder takes a continuation byte straight after a complete frame as that
+// frame's sequence number, so it must only be used with a numbered DashSender.  To an
+// unnumbered one, that byte is garbage like any other: a frame whose marker bit was lost
+// can't pass for a sequence number.
+//
+// Each loss of framing is reported once, as a drop, however many bytes or partial frames it
+// takes to find the next complete frame.  A flipped marker bit mid-frame both cuts that frame
+// short and starts a bogus one, but it's still only the one frame that was lost.
+typedef struct DashDecoder {
+
+  // what a byte amounted to
+  enum Event {
+    none     = 0, // nothing new: the byte was part of a frame, or skipped
+    frame    = 1, // the byte completed a frame, which is now in message
+    dropped  = 2, // the byte showed that the stream had lost its framing
+    sequence = 3, // the byte was the sequence number of the last frame, now in lastSequence
+  };
+
+  DashMessage message;              // the last complete frame
+  byte partial[DashMessage::length]; // the frame being put together
+  uint8_t filled;                   // how many bytes of the partial frame have arrived
+  bool hunting;                     // whether we're skipping bytes until the next frame starts
+  bool numbered;                    // whether a sequence number follows each frame
+  bool afterFrame;                  // whether the last byte completed a frame
+  bool lost;                        // whether the framing has been lost since the last complete frame
+  uint8_t lastSequence;             // the last sequence number received
+
+  unsigned long frames;  // complete frames decoded
+  unsigned long resyncs; // times the framing was lost
+  unsigned long skipped; // bytes thrown away while looking for the next frame
+
+  DashDecoder(bool readSequence = false) : numbered(readSequence) { reset(); }
+
+  // forget everything, including any partial frame
+  void reset() {
+    message = DashMessage();
+    filled = 0;
+    hunting = false;
+    afterFrame = false;
+    lost = false;
+    lastSequence = 0;
+    frames = 0;
+    resyncs = 0;
+    skipped = 0;
+  }
+
+  // take one byte from the wire
+  Event push(byte b) {
+    Event ret = Event::none;
+    if (numbered && afterFrame && !(b & FIRST_FRAME_MARKER_MASK)) {
+      afterFrame = false;
+      lastSequence = b;
+      return Event::sequence;
+    }
+    afterFrame = false;
+
+    if (b & FIRST_FRAME_MARKER_MASK) {
+      if (filled && !lost) {
+        ++resyncs; // the last frame never finished
+        ret = Event::dropped;
+      }
+      lost = lost || filled;
+      hunting = false;
+      filled = 0;
+    } else if (!filled) {
+      ++skipped;
+      if (hunting) return Event::none;
+      hunting = true;
+      if (lost) return Event::none;
+      lost = true;
+      ++resyncs;
+      return Event::dropped;
+    }
+
+    partial[filled++] = b;
+    if (filled < DashMessage::length) return ret;
+
+    message.setRawBytes(partial);
+    filled = 0;
+    afterFrame = true;
+    lost = false;
+    ++frames;
+    return Event::frame;
+  }
+
+  // summary of the decoding statistics
+  String toString() const {
+    char ret[sizeof("rx  rs  sk ") + 3 * ULONG_TEXT_DIGITS];
+    snprintf(ret, sizeof(ret), "rx %lu rs %lu sk %lu", frames, resyncs, skipped);
+    return String(ret);
+  }
+} DashDecoder;
@@ -1,8 +1,11 @@
 #pragma once
 
 #include "DashMessage.h"
+#include "DashMailbox.h"
+#include "LinkMonitor.h"
 #include "CalibratedServo.h"
 #include "LEDState.h"
+#include "StripRenderer.h"
 
 
 #ifndef ARDUINO_CI_COMPILATION_MOCKS
@@ -39,6 +42,7 @@ const Range oilServoLimit   { 0, 180 };
 // define limits for LED strip brightness
 const Range LEDStripBrightnessLimit { 5, 255 };
 const int dimBrightnessLevel = LEDStripBrightnessLimit.midpoint();
+const unsigned int LED_STRIP_MIN_FRAME_MS = 10; // don't push frames to the strip faster than 100Hz
 
 const unsigned int ARDUINO_BOOT_ANIMATION_MS = 2000; // amount of time that we can use to do a bootup sequence
 const unsigned int ARDUINO_SOFT_SHUTDOWN_MS = 3000; // amount of time that we can use to do a soft shutdown
@@ -113,6 +117,35 @@ typedef struct DashSupport {
   CFastLED* fastLed;
 } DashSupport;
 
+// The same support, bound at compile time: each function is a type of its own, so a
+// DashStateT<ArduinoSupport> calls the Arduino functions directly (and the compiler can
+// inline them), where a DashState makes an indirect call through the DashSupport table.
+// A mock policy only needs members that can be called the same way.  The modes and values
+// are passed along as they're given, since some cores take them as enums rather than ints.
+typedef struct ArduinoSupport {
+  struct PinMode {
+    template<typename Mode>
+    inline void operator()(pin_size_t pin, Mode mode) const { ::pinMode(pin, mode); }
+  } pinMode;
+
+  struct AnalogRead {
+    inline int operator()(pin_size_t pin) const { return ::analogRead(pin); }
+  } analogRead;
+
+  struct DigitalRead {
+    inline int operator()(pin_size_t pin) const { return ::digitalRead(pin); }
+  } digitalRead;
+
+  struct DigitalWrite {
+    template<typename Value>
+    inline void operator()(pin_size_t pin, Value val) const { ::digitalWrite(pin, val); }
+  } digitalWrite;
+
+  CFastLED* fastLed;
+
+  ArduinoSupport(CFastLED* f) : fastLed(f) {}
+} ArduinoSupport;
+
 
 
 
@@ -157,6 +190,47 @@ const struct LEDPosition ledPosition[NUM_DASH_LEDS] = {
 };
 
 
+// The behavior of each LED on the dash, in strip order.
+// This generates the storage for all the stateful LEDs at compile time.
+typedef LEDLayout<
+  LEDSlot<            TachLED, DashLED::Values::tach0>,
+  LEDSlot<            TachLED, DashLED::Values::tach1>,
+  LEDSlot<            TachLED, DashLED::Values::tach2>,
+  LEDSlot<            TachLED, DashLED::Values::tach3>,
+  LEDSlot<            TachLED, DashLED::Values::tach4>,
+  LEDSlot<            TachLED, DashLED::Values::tach5>,
+  LEDSlot<            TachLED, DashLED::Values::tach6>,
+  LEDSlot<    IlluminationLED, DashLED::Values::gauge1>,
+  LEDSlot<    IlluminationLED, DashLED::Values::gauge0>,
+  LEDSlot<    IlluminationLED, DashLED::Values::CAN>,
+  LEDSlot<    IlluminationLED, DashLED::Values::gauge3>,
+  LEDSlot<    IlluminationLED, DashLED::Values::gauge2>,
+  LEDSlot<    IlluminationLED, DashLED::Values::speed0>,
+  LEDSlot<    IlluminationLED, DashLED::Values::speed1>,
+  LEDSlot<    IlluminationLED, DashLED::Values::speed2>,
+  LEDSlot<    IlluminationLED, DashLED::Values::speed3>,
+  LEDSlot<    IlluminationLED, DashLED::Values::speed4>,
+  LEDSlot<    IlluminationLED, DashLED::Values::speed5>,
+  LEDSlot<    IlluminationLED, DashLED::Values::speed6>,
+  LEDSlot<    IlluminationLED, DashLED::Values::clock>,
+  LEDSlot<    IlluminationLED, DashLED::Values::oilDial>,
+  LEDSlot<    IlluminationLED, DashLED::Values::boostDial>,
+  LEDSlot<    IlluminationLED, DashLED::Values::voltsDial>,
+  LEDSlot<           BoostLED, DashLED::Values::boostInd>,
+  LEDSlot<         AirCondLED, DashLED::Values::airConditioningInd>,
+  LEDSlot<HeatedRearWindowLED, DashLED::Values::heatedRearWindowInd>,
+  LEDSlot<      RearFoggerLED, DashLED::Values::rearFogLightInd>,
+  LEDSlot<          HazardLED, DashLED::Values::hazardInd>,
+  LEDSlot<    IlluminationLED, DashLED::Values::auxLight>,
+  LEDSlot<    IlluminationLED, DashLED::Values::heater0>,
+  LEDSlot<    IlluminationLED, DashLED::Values::heater1>,
+  LEDSlot<    IlluminationLED, DashLED::Values::windowSw1>,
+  LEDSlot<    IlluminationLED, DashLED::Values::windowSw0>
+> DashLEDLayout;
+
+static_assert(DashLEDLayout::size == NUM_DASH_LEDS, "Every LED on the dash needs a behavior");
+
+
 
 
 // The state of the dashboard.
@@ -168,12 +242,20 @@ const struct LEDPosition ledPosition[NUM_DASH_LEDS] = {
 //   * the current time, in millis
 // make all decisions about what the output should look like, and
 // apply that output.
-typedef struct DashState {
-  DashSupport support;
-  SlaveState lastState;
-  SlaveState nextState;
+//
+// Everything it does to the hardware goes through the Support: a DashSupport table of
+// function pointers (a DashState), or a compile-time policy like ArduinoSupport.
+template<typename Support>
+struct DashStateT {
+  Support support;
+  SlaveState lastState;     // the sample being applied
+  SlaveState nextState;     // the sample being collected
+  SlaveEvents events;       // the debouncing of the samples, which carries over between them
+  DashMailbox mailbox;      // messages from the I2C receiver, taken at the top of apply()
+  LinkMonitor link;         // how well we're hearing from the master
 
   struct CRGB leds[NUM_DASH_LEDS];
+  StripRenderer<NUM_DASH_LEDS> renderer;
 
   CalibratedServo fuelGauge;
   CalibratedServo tempGauge;
@@ -182,43 +264,13 @@ typedef struct DashState {
   unsigned long bootStartTime;
   unsigned long ignitionLastOnTime;
 
-  // can't declare an array of abstract classes, so declare an array
-  // of pointers to those abstract classes.  hence the use of "new".
-  StatefulLED* statefulLeds[NUM_DASH_LEDS] = {
-    new             TachLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::tach0),
-    new             TachLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::tach1),
-    new             TachLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::tach2),
-    new             TachLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::tach3),
-    new             TachLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::tach4),
-    new             TachLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::tach5),
-    new             TachLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::tach6),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::gauge1),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::gauge0),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::CAN),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::gauge3),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::gauge2),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::speed0),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::speed1),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::speed2),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::speed3),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::speed4),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::speed5),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::speed6),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::clock),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::oilDial),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::boostDial),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::voltsDial),
-    new            BoostLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::boostInd),
-    new          AirCondLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::airConditioningInd),
-    new HeatedRearWindowLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::heatedRearWindowInd),
-    new       RearFoggerLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::rearFogLightInd),
-    new           HazardLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::hazardInd),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::auxLight),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::heater0),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::heater1),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::windowSw1),
-    new     IlluminationLED(leds, ledPosition, NUM_DASH_LEDS, DashLED::Values::windowSw0)
-  };
+  LEDSchedule<NUM_DASH_LEDS> ledSchedule;
+  LEDInputMask pendingLEDInputs; // input changes the LEDs haven't been shown yet (e.g. during shutdown or an effect)
+
+  GlobalEffects effects;    // the effect states shared by all the LEDs
+  int16_t shimmerOffsets[NUM_DASH_LEDS]; // the per-LED part of the shimmer, which never changes
+  LEDStrip strip;           // what all the LEDs need to know about the strip
+  DashLEDLayout statefulLeds;
 
   // measure the time since the first measured time
   inline bool inBootSequence(unsigned long const &nMillis) const {
@@ -238,8 +290,7 @@ typedef struct DashState {
       0, ARDUINO_BOOT_ANIMATION_MS,
       LEDStripBrightnessLimit.min, initialBrightness
     );
-    support.fastLed->setBrightness(rampedBrightness);
-    support.fastLed->show();
+    renderer.render(support.fastLed, leds, rampedBrightness, nMillis);
   }
 
   // scripted shutdown animation
@@ -250,8 +301,7 @@ typedef struct DashState {
       0, ARDUINO_SOFT_SHUTDOWN_MS,
       LEDStripBrightnessLimit.min, initialBrightness
     );
-    support.fastLed->setBrightness(rampedBrightness);
-    support.fastLed->show();
+    renderer.render(support.fastLed, leds, rampedBrightness, nMillis);
 
     // park all servos
     fuelGauge.writeMin();
@@ -268,18 +318,45 @@ typedef struct DashState {
 
   // construct empty container
   // This is also where we set the calibration data for the servos
-  DashState(DashSupport ds):
+  DashStateT(Support ds):
     support(ds),
+    renderer(LED_STRIP_MIN_FRAME_MS),
     fuelGauge(SlavePin::Values::fuelServo, fuelSenderLimit, fuelServoLimit),
     tempGauge(SlavePin::Values::tempServo, tempSenderLimit, tempServoLimit),
-    oilGauge( SlavePin::Values::oilServo,  oilSenderLimit,  oilServoLimit)
-  {}
+    oilGauge( SlavePin::Values::oilServo,  oilSenderLimit,  oilServoLimit),
+    pendingLEDInputs(LED_INPUT_NONE),
+    strip{leds, ledPosition, NUM_DASH_LEDS, &effects, shimmerOffsets, {}}
+  {
+    effects.shimmer.precompute(strip);
+  }
 
-  // accept a message from I2C
+  // accept a message directly.  only for use from the main loop
   void setMessage(DashMessage const &dm) {
     nextState.setMasterSignals(dm);
   }
 
+  // accept a message from I2C.  safe to call from the interrupt handler;
+  // the message takes effect on the next apply()
+  inline void postMessage(DashMessage const &dm) {
+    mailbox.post(dm);
+  }
+
+  // accept a message from I2C, and note when it arrived.  safe to call from the interrupt handler
+  inline void postMessage(DashMessage const &dm, unsigned long const &nMillis) {
+    mailbox.post(dm);
+    link.frameArrived(nMillis);
+  }
+
+  // accept the sequence number of the last message.  safe to call from the interrupt handler
+  inline void postSequence(uint8_t sequence) {
+    link.sequenceArrived(sequence);
+  }
+
+  // count a message from I2C that couldn't be decoded.  safe to call from the interrupt handler
+  inline void dropMessage() {
+    mailbox.drop();
+  }
+
   inline SlaveState& state() {
     return nextState;
   }
@@ -289,29 +366,47 @@ typedef struct DashState {
     return lastState;
   }
 
-  // accept a hardware state
-  void setState(SlaveState state) {
-    DashMessage d(nextState.masterMessage);
+  // accept a hardware state.  the master's message is kept as it is
+  void setState(SlaveState const &state) {
+    const DashMessage d = nextState.masterMessage;
     nextState = state;
     nextState.masterMessage = d;
   }
 
   // accept a hardware state
-  void setSlaveState(int (*myDigitalRead)(pin_size_t), int (*myAnalogRead)(pin_size_t)) {
+  template<typename DigitalRead, typename AnalogRead, typename = IfPinReader<DigitalRead>>
+  void setSlaveState(DigitalRead myDigitalRead, AnalogRead myAnalogRead) {
     nextState.setFromPins(myDigitalRead, myAnalogRead);
   }
 
-#ifdef PinStatus
-  // accept a hardware state
-  void setSlaveState(PinStatus (*myDigitalRead)(pin_size_t), int (*myAnalogRead)(pin_size_t)) {
-    nextState.setFromPins(myDigitalRead, myAnalogRead);
+  // accept a hardware state, with the digital pins read a port at a time
+  template<typename AnalogRead>
+  void setSlaveState(PortSnapshot const &ports, AnalogRead myAnalogRead) {
+    nextState.setFromPorts(ports, myAnalogRead);
+  }
+
+  // accept a hardware state, read through the support
+  inline void setSlaveState() {
+    nextState.setFromPins(support.digitalRead, support.analogRead);
+  }
+
+  // accept a hardware state, with the digital pins read a port at a time and the rest through the support
+  inline void setSlaveState(PortSnapshot const &ports) {
+    nextState.setFromPorts(ports, support.analogRead);
   }
-#endif
 
   // reset members (helpful for unit testing)
   void reset() {
     bootStartTime = 0;
     ignitionLastOnTime = 0;
+    renderer.reset();
+    ledSchedule.reset(0);
+    pendingLEDInputs = LED_INPUT_NONE;
+    effects.reset();
+    mailbox.reset();
+    link.reset();
+    strip.flash = FlashClock();
+    events.reset();
     SlaveState newstate;
     lastState = newstate;
     nextState = newstate;
@@ -329,7 +424,8 @@ typedef struct DashState {
     tempGauge.setup();
     oilGauge.setup();
 
-    support.fastLed->addLeds<LED_TYPE, SlavePin::Values::ledStrip, COLOR_ORDER>(leds, NUM_DASH_LEDS).setCorrection(TypicalLEDStrip);
+    CFastLED* fastLed = support.fastLed;
+    renderer.controller = &fastLed->addLeds<LED_TYPE, SlavePin::Values::ledStrip, COLOR_ORDER>(leds, NUM_DASH_LEDS).setCorrection(TypicalLEDStrip);
 
     reset();
   }
@@ -340,12 +436,20 @@ typedef struct DashState {
     ret.concat(!slaveState.ignition ? "HALT" : (inBootSequence(nMillis) ? "BOOT" : " OK "));
     ret.concat("] ");
     ret.concat(slaveState.toString());
+    ret.concat(" ");
+    ret.concat(events.toString());
+    ret.concat(" ");
+    ret.concat(renderer.toString());
+    ret.concat(" ");
+    ret.concat(effects.toString());
+    ret.concat(" ");
+    ret.concat(mailbox.toString());
+    ret.concat(" ");
+    ret.concat(link.toString());
 
     // include all stateful LEDs
-    for (unsigned int i = DASH_LED_MIN; i < NUM_DASH_LEDS; ++i) {
-      ret.concat(i % 7 == 0 ? "\n" : " ");
-      ret.concat(statefulLeds[i]->toString(nMillis));
-    }
+    LEDDescription description = { ret, strip, nMillis };
+    statefulLeds.visit(description);
 
     return ret;
   }
@@ -363,8 +467,14 @@ typedef struct DashState {
   // apply the internal state to the hardware
   void apply(unsigned long const &nMillis) {
     // DATA SAFETY SECTION: ensure state data isn't corrupted
-    nextState.debounce(nMillis);
-    lastState = nextState; // try to keep the async 2wire receiver from interfering with current state
+    DashMessage posted;
+    if (mailbox.take(posted)) nextState.setMasterSignals(posted);
+    if (link.update(nMillis)) nextState.setMasterSignals(failsafeDashMessage()); // FAILSAFE: the master has gone quiet, so nothing is on
+    events.debounce(nMillis, nextState);
+    SlaveState debounced = nextState; // a plain 10-byte copy; the I2C receiver only touches the mailbox, so it's consistent
+    events.stabilize(debounced);
+    pendingLEDInputs |= debounced.changedLEDInputs(lastState); // kept until the LEDs next get a look
+    lastState = debounced;
     if (0 == bootStartTime) bootStartTime = nMillis; // get a real measure of boot start time
 
     // TODO: delete the list when everything's crossed off it
@@ -374,7 +484,7 @@ typedef struct DashState {
 
 
     // EXISTENTIAL SECTION: ensure board is powered when we want power
-    digitalWrite(SlavePin::Values::optoCoupler, shouldUseOpto(lastState.ignition, nMillis));
+    support.digitalWrite(SlavePin::Values::optoCoupler, shouldUseOpto(lastState.ignition, nMillis) ? HIGH : LOW);
 
     // GRACEFUL EXIT SECTION: perform shutdown animation/tasks if we're in shutdown, and nothing more
     if (!lastState.ignition) {
@@ -385,11 +495,15 @@ typedef struct DashState {
 
     // STUFF ALLOWED DURING BOOT SECTION:
     // update the scroll CAN button state
-    support.digitalWrite(SlavePin::Values::scrollCAN, lastState.scrollCANstate(nMillis) ? HIGH : LOW);
-
-    // update all stateful LEDs from the input. this will mean they're always the right hue
-    for (unsigned int i = DASH_LED_MIN; i < NUM_DASH_LEDS; ++i) {
-      statefulLeds[i]->loop(nMillis, lastState);
+    support.digitalWrite(SlavePin::Values::scrollCAN, events.scrollCANstate(nMillis) ? HIGH : LOW);
+
+    // update the stateful LEDs from the input. this will mean they're always the right hue.
+    // a global effect paints the whole strip in one pass, and the LEDs' own states sit it out.
+    // otherwise only the LEDs that are due, or that subscribe to an input that changed, need to be looked at
+    if (!effects.render(strip, lastState.effectmode.state, nMillis)) {
+      strip.flash.update(nMillis);
+      ledSchedule.loop(statefulLeds, strip, pendingLEDInputs, nMillis, lastState);
+      pendingLEDInputs = LED_INPUT_NONE;
     }
 
     // BOOT SEQUENCE SECTION: perform boot animation if we're in boot, and nothing more
@@ -405,9 +519,18 @@ typedef struct DashState {
     tempGauge.write(lastState.temperatureLevel);
     oilGauge.write(lastState.oilPressureLevel);
 
-    // update the overall LED strip brightness according to dimmer signal
-    support.fastLed->setBrightness(lastState.backlightDim ? dimBrightnessLevel : LEDStripBrightnessLimit.max);
-    support.fastLed->show();
+    // update the overall LED strip brightness according to dimmer signal.
+    // the renderer will only push this to the strip if something actually changed
+    const int brightness = lastState.backlightDim ? dimBrightnessLevel : LEDStripBrightnessLimit.max;
+    renderer.render(support.fastLed, leds, brightness, nMillis);
   }
 
-} DashState;
+};
+
+// the dash, with its hardware support in a table of function pointers
+typedef DashStateT<DashSupport> DashState;
+
+#ifdef __AVR__
+// an Uno has 2048 bytes of RAM, and the sketch, the stack and the Wire buffers need what's left
+static_assert(sizeof(DashState) <= 1792, "The dash has outgrown its share of the board's RAM");
+#endif
@@ -26,6 +26,14 @@ typedef struct Debouncer {
     last(Event::none)
   {}
 
+  // forget all history, as if newly constructed
+  void reset() {
+    lastStableTime = 0;
+    stableState = false;
+    lastReading = false;
+    last = Event::none;
+  }
+
   // force the debouncer into an initial state without generating an event
   void force(bool desiredState) {
     lastStableTime = 0;
@@ -54,3 +62,116 @@ typedef struct Debouncer {
   private:
     Debouncer(): stableTime(0) {}
 } Debouncer;
+
+
+// Debounce a whole set of signals at once, one bit per signal, with the same results as
+// a Debouncer per signal.
+//
+// Each signal has a countdown of the milliseconds left before a differing reading is accepted.
+// The countdowns are stored as "vertical counters": bit k of every signal's count lives in
+// counter[k], so one pass of bitwise operations updates every signal's count together.  A
+// signal's count is held at its stable time while its reading agrees with its debounced state,
+// and counts down while the reading differs; when it has reached zero and the reading still
+// differs, the debounced state flips and the signal shows up in the rose or fell mask.
+//
+// Mask is an unsigned integer with a bit for each signal (e.g. uint16_t, uint32_t), and
+// CounterBits sets the longest stable time to (2^CounterBits - 1) ms.
+template <typename Mask, unsigned int CounterBits = 6>
+struct DebouncerBank {
+  static const unsigned long MAX_STABLE_TIME = (1ul << CounterBits) - 1;
+
+  Mask stable;                  // the debounced state of each signal
+  Mask rose;                    // the signals that went high on the last process()
+  Mask fell;                    // the signals that went low on the last process()
+  Mask reading;                 // the last reading of each signal
+  Mask counter[CounterBits];    // the time left before each signal's differing reading is accepted
+  Mask stableTime[CounterBits]; // each signal's stable time, laid out the same way
+  unsigned long lastTime;       // when process() was last called
+
+  DebouncerBank() {
+    for (unsigned int k = 0; k < CounterBits; ++k) stableTime[k] = 0;
+    reset();
+  }
+
+  // forget all history.  the stable times are kept
+  void reset() {
+    stable = 0;
+    rose = 0;
+    fell = 0;
+    reading = 0;
+    lastTime = 0;
+    reload((Mask)~(Mask)0);
+  }
+
+  // set the stable time of some signals, in ms.  by default it's 0: readings are accepted as-is
+  void setStableTime(Mask signals, unsigned int ms) {
+    for (unsigned int k = 0; k < CounterBits; ++k) {
+      if ((ms >> k) & 1) {
+        stableTime[k] |= signals;
+      } else {
+        stableTime[k] &= (Mask)~signals;
+      }
+    }
+    reload(signals);
+  }
+
+  // restart the countdown for some signals
+  inline void reload(Mask signals) {
+    for (unsigned int k = 0; k < CounterBits; ++k) {
+      counter[k] = (counter[k] & (Mask)~signals) | (stableTime[k] & signals);
+    }
+  }
+
+  // subtract the same time from the countdowns of some signals, stopping at zero
+  inline void countDown(Mask signals, unsigned long ms) {
+    Mask borrow = 0;
+    for (unsigned int k = 0; k < CounterBits; ++k) {
+      const Mask sub = ((ms >> k) & 1) ? signals : 0;
+      const Mask c = counter[k];
+      counter[k] = c ^ sub ^ borrow;
+      borrow = ((Mask)~c & (sub | borrow)) | (sub & borrow);
+    }
+    // a borrow out of the top means the count went below zero
+    for (unsigned int k = 0; k < CounterBits; ++k) counter[k] &= (Mask)~borrow;
+  }
+
+  // accept new readings of every signal
+  void process(unsigned long const &millis, Mask newReading) {
+    // the previous readings have held since the last call.  usually, nothing is counting down
+    const Mask wasDiffering = reading ^ stable;
+    const unsigned long elapsed = millis - lastTime;
+    if (wasDiffering) countDown(wasDiffering, elapsed < MAX_STABLE_TIME ? elapsed : MAX_STABLE_TIME);
+    lastTime = millis;
+    reading = newReading;
+    rose = 0;
+    fell = 0;
+
+    // signals that agree with their state again start over
+    const Mask differ = reading ^ stable;
+    if (wasDiffering & (Mask)~differ) reload(wasDiffering & (Mask)~differ);
+    if (!differ) return;
+
+    // ones that have differed for long enough flip
+    Mask pending = 0;
+    for (unsigned int k = 0; k < CounterBits; ++k) pending |= counter[k];
+    const Mask flip = differ & (Mask)~pending;
+    if (!flip) return;
+
+    stable ^= flip;
+    rose = flip & stable;
+    fell = flip & (Mask)~stable;
+    reload(flip);
+  }
+
+  // the debounced state of a signal
+  inline bool isHigh(Mask signal) const {
+    return stable & signal;
+  }
+
+  // the event that a signal generated on the last process(), in Debouncer terms
+  inline Debouncer::Event eventOf(Mask signal) const {
+    if (rose & signal) return Debouncer::Event::toHigh;
+    if (fell & signal) return Debouncer::Event::toLow;
+    return Debouncer::Event::none;
+  }
+};
@@ -727,15 +727,100 @@ struct CHSV rgb2hsv_approximate(struct CRGB rgb) { return CHSV(rgb.r, rgb.g, rgb
 #define TypicalLEDStrip 333
 typedef bool WS2812B;
 
+// how many of the most recent pushes a fake strip remembers
+const unsigned int FAKE_FRAME_LOG_LENGTH = 64;
+
+// one push to a fake strip
+typedef struct FakeFrame {
+  unsigned long time;   // millis() when it was pushed
+  int pixels;           // how many pixels were sent
+  uint8_t brightness;   // at what brightness
+  uint32_t hash;        // a hash of the pixels that were sent
+} FakeFrame;
+
+// a single strip of LEDs.  each push to the strip records how many pixels were sent, and
+// the most recent pushes are kept in a log, for tests of how much work the output is doing
+typedef struct CLEDController {
+  struct CRGB* data;
+  int numLeds;
+  unsigned long numPushes;     // how many times pixels were sent to this strip
+  int lastPushPixels;          // how many pixels were sent in the most recent push
+  unsigned long pixelsPushed;  // total pixels sent to this strip
+  unsigned long repeatPushes;  // pushes that sent exactly what the previous one did
+  FakeFrame frames[FAKE_FRAME_LOG_LENGTH]; // the most recent pushes, as a ring
+
+  CLEDController() : data(nullptr), numLeds(0), numPushes(0), lastPushPixels(0), pixelsPushed(0), repeatPushes(0) {}
+
+  CLEDController& setCorrection(int) { return *this; }
+
+  // send a prefix of a pixel buffer to the strip
+  void show(const struct CRGB* leds, int nLeds, uint8_t brightness) {
+    FakeFrame f = { millis(), nLeds, brightness, 2166136261u }; // FNV-1a
+    for (int i = 0; i < nLeds; ++i) {
+      for (int c = 0; c < 3; ++c) f.hash = (f.hash ^ leds[i].raw[c]) * 16777619u;
+    }
+    if (numPushes) {
+      const FakeFrame &last = recentFrame(0);
+      if (last.pixels == f.pixels && last.brightness == f.brightness && last.hash == f.hash) ++repeatPushes;
+    }
+    frames[numPushes % FAKE_FRAME_LOG_LENGTH] = f;
+
+    ++numPushes;
+    lastPushPixels = nLeds;
+    pixelsPushed += nLeds;
+  }
+
+  // send the whole strip
+  void showLeds(uint8_t brightness = 255) { show(data, numLeds, brightness); }
+
+  // forget the counts and the log
+  void clearLog() {
+    numPushes = 0;
+    lastPushPixels = 0;
+    pixelsPushed = 0;
+    repeatPushes = 0;
+  }
+
+  // how many pushes are in the log
+  inline unsigned int logged() const {
+    return numPushes < FAKE_FRAME_LOG_LENGTH ? numPushes : FAKE_FRAME_LOG_LENGTH;
+  }
+
+  // a push from the log: 0 is the last one, 1 the one before, and so on
+  inline const FakeFrame& recentFrame(unsigned int back) const {
+    return frames[(numPushes - 1 - back) % FAKE_FRAME_LOG_LENGTH];
+  }
+
+  // the most pushes in the log that fall within any window of the given length.  a test
+  // that the strip gets no more than N pushes per 100ms is maxPushesWithin(100) <= N
+  unsigned int maxPushesWithin(unsigned long windowMs) const {
+    unsigned int ret = 0;
+    for (unsigned int newest = 0; newest < logged(); ++newest) {
+      unsigned int n = 1;
+      while (newest + n < logged() && recentFrame(newest).time - recentFrame(newest + n).time < windowMs) ++n;
+      if (n > ret) ret = n;
+    }
+    return ret;
+  }
+} CLEDController;
+
 typedef struct CFastLED {
   int brightness;
+  unsigned long numShows; // how many times show() has been called
+  CLEDController controller;
+
+  CFastLED() : brightness(0), numShows(0) {}
 
   CFastLED setBrightness(int b) { brightness = b; return *this; }
   CFastLED setCorrection(int) { return *this; }
 
-  void show() {};
+  void show() { ++numShows; controller.showLeds(brightness); };
 
   template<typename T1, uint8_t T2, EOrder T3>
-  CFastLED addLeds(struct CRGB *data, int nLedsOrOffset, int nLedsIfOffset = 0) { return *this; }
+  CLEDController& addLeds(struct CRGB *data, int nLedsOrOffset, int nLedsIfOffset = 0) {
+    controller.data = data;
+    controller.numLeds = nLedsIfOffset ? nLedsIfOffset : nLedsOrOffset;
+    return controller;
+  }
 
 } CFastLED;
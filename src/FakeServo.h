@@ -1,9 +1,43 @@
 #pragma once
 
+// how many of the most recent positions a fake servo remembers
+const unsigned int FAKE_SERVO_LOG_LENGTH = 16;
+
+// A servo that records what it's told.  Every write() is counted, and so is every write of
+// the position it was already at -- on the real thing, that's traffic that does nothing
 typedef struct Servo {
   int pin;
   int pos;
+  bool hasPosition;                   // whether it's been written at all, log or no log
+  unsigned long writes;               // calls to write()
+  unsigned long rewrites;             // writes of the position it already had
+  int log[FAKE_SERVO_LOG_LENGTH];     // the most recent positions written, as a ring
+
+  Servo() : pin(-1), pos(0), hasPosition(false), writes(0), rewrites(0) {}
 
   void attach(int p) { pin = p; }
-  void write(int p) { pos = p; }
+
+  void write(int p) {
+    if (hasPosition && p == pos) ++rewrites;
+    log[writes % FAKE_SERVO_LOG_LENGTH] = p;
+    ++writes;
+    pos = p;
+    hasPosition = true;
+  }
+
+  // forget the counts and the log, but not where it is
+  void clearLog() {
+    writes = 0;
+    rewrites = 0;
+  }
+
+  // how many positions are in the log
+  inline unsigned int logged() const {
+    return writes < FAKE_SERVO_LOG_LENGTH ? writes : FAKE_SERVO_LOG_LENGTH;
+  }
+
+  // a position from the log: 0 is the last one written, 1 the one before, and so on
+  inline int recentWrite(unsigned int back) const {
+    return log[(writes - 1 - back) % FAKE_SERVO_LOG_LENGTH];
+  }
 } Servo;
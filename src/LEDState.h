@@ -30,6 +30,10 @@
 
 const int FLASH_DURATION_MS = 100;  // what we want for all flashing LEDs. this is 1/2 of the flash
 
+// how far in the future to schedule a state that will never change on its own.
+// a wakeup this far out is harmless even when it does arrive; the state just gets reevaluated
+const unsigned long LED_IDLE_WAKE_MS = 0x3FFFFFFF;
+
 const struct CRGB COLOR_BLACK  = CRGB::HTMLColorCode(CRGB::Black);
 const struct CRGB COLOR_WHITE  = CRGB::HTMLColorCode(CRGB::White);
 const struct CRGB COLOR_RED    = CRGB::HTMLColorCode(CRGB::Red);
@@ -37,6 +41,14 @@ const struct CRGB COLOR_YELLOW = CRGB::HTMLColorCode(CRGB::Yellow);
 const struct CRGB COLOR_BLUE   = CRGB::HTMLColorCode(CRGB::Blue);
 const struct CRGB COLOR_AMBER  = CRGB((uint32_t)0xFFBF00);
 
+// convert an HSV color to RGB.  states that show a fixed color do this once, up front,
+// so that FastLED doesn't have to convert it again on every frame
+inline struct CRGB toRGB(const struct CHSV &hsv) {
+  struct CRGB ret;
+  ret = hsv; // FastLED converts on assignment
+  return ret;
+}
+
 
 // define the LED position in physical space,
 // relative to upper left of console,
@@ -47,11 +59,46 @@ struct LEDPosition {
   unsigned int y;
 };
 
+
+// the phase of all flashing on a strip.  It's worked out once per frame, and every flashing
+// LED just reads it -- so they all flash in step, and none of them has to do its own division
+struct FlashClock {
+  bool firstHalf;         // whether we're in the first ("loud") half of a flash
+  unsigned long nextEdge; // when the flash next switches halves
+
+  FlashClock() : firstHalf(true), nextEdge(0) {}
+
+  // bring the phase up to date.  between edges, there's nothing to work out
+  inline void update(unsigned long const &millis) {
+    if ((long)(millis - nextEdge) < 0) return;
+    const unsigned long half = millis / FLASH_DURATION_MS;
+    firstHalf = !(half & 1);
+    nextEdge = (half + 1) * FLASH_DURATION_MS;
+  }
+};
+
+// the effect states shared by every LED on a strip, defined below
+struct GlobalEffects;
+
+// everything about a strip that its LEDs share.  The LEDs themselves only know their
+// current state; they get this (along with their own index) on every call
+struct LEDStrip {
+  struct CRGB* leds;                   // the pixels, as used by FastLED
+  const struct LEDPosition* positions; // where each LED is
+  unsigned int numLEDs;                // the number of LEDs in the whole strip
+  struct GlobalEffects* effects;       // the strip-wide effect states
+  int16_t* lineOffsets;                // each LED's precomputed part of the shimmer distance, if not null
+  struct FlashClock flash;             // the phase of all flashing LEDs, updated once per frame
+};
+
 // abstract class for an LED state.
 // the class's responsibility is to determine when it's OK to change state,
 // and to handle the LED behavior while in the state (based on the time and
 // on whatever extra member variables are provided by the child classes)
 //
+// a state is told which LED it's driving on each call, so a single state object
+// can be shared by any number of LEDs as long as it keeps no per-LED data.
+//
 // note that the the LED is going to be a CRGB struct, but we can assign CHSV values to it, and
 // those values will automatically be converted by FastLED's library as part of the "=" operator.
 // RGB is what the hardware expects.
@@ -68,44 +115,64 @@ public:
   // perform any specific activation
   virtual void activateLocal() { }
 
-  // what to do with the LED in this state, on one tick
-  virtual void loop(struct CRGB* led, unsigned long const &millis) = 0;
+  // what to do with the LED at the given index in this state, on one tick
+  virtual void loop(const struct LEDStrip &strip, unsigned int index, unsigned long const &millis) = 0;
 
   // whether the state is expired.  by default, it's always time to reevaulate
-  virtual bool isExpired(unsigned long const & /* millis */) const { return true; }
+  virtual bool isExpired(const struct LEDStrip & /* strip */, unsigned long const & /* millis */) const { return true; }
+
+  // the next time at which this state will change the LED or expire on its own (i.e. with
+  // no change in inputs).  by default, that's the next tick
+  virtual unsigned long nextWakeTime(const struct LEDStrip & /* strip */, unsigned int /* index */, unsigned long const &millis) const {
+    return millis + 1;
+  }
 
   // string representation
-  virtual String toStringWithParams(unsigned long const & /* millis */) const = 0;
+  virtual String toStringWithParams(const struct LEDStrip &strip, unsigned int index, unsigned long const &millis) const = 0;
 
   // string representation
-  virtual String toString(unsigned long const &millis) const {
-    String ret = isExpired(millis) ? "E" : "_";
+  virtual String toString(const struct LEDStrip &strip, unsigned int index, unsigned long const &millis) const {
+    String ret = isExpired(strip, millis) ? "E" : "_";
     ret.concat("|");
-    ret.concat(toStringWithParams(millis));
+    ret.concat(toStringWithParams(strip, index, millis));
     return ret;
   }
 
 };
 
 // a state to just show a solid color.  The color is provided on init of the state
+//
+// The color is kept as RGB, which is what the strip takes; it's converted at most once.
+// When it's given as RGB in the first place, it's shown exactly as given.
 class SolidColorState : public LEDState {
 public:
-  const struct CHSV m_color;
+  const struct CRGB m_rgb;
 
   // constructor initializes all things
-  SolidColorState(const struct CHSV &hsv) : LEDState(), m_color(hsv) {}
-  SolidColorState(const struct CRGB &rgb) : SolidColorState(rgb2hsv_approximate(rgb)) {}
+  SolidColorState(const struct CRGB &rgb) : LEDState(), m_rgb(rgb) {}
+  SolidColorState(const struct CHSV &hsv) : SolidColorState(toRGB(hsv)) {}
+
+  // the color as HSV, for display
+  inline struct CHSV hsv() const {
+    return rgb2hsv_approximate(m_rgb);
+  }
 
   // the state just applies the saved color.
   // TODO: we could consider rapidly fading toward this color from whatever color was currently being displayed
-  virtual void loop(struct CRGB* led, unsigned long const & /* millis */) override {
-    *led = m_color; // TODO: see if there's a FastLED method for doing this more natively
+  virtual void loop(const struct LEDStrip &strip, unsigned int index, unsigned long const & /* millis */) override {
+    strip.leds[index] = m_rgb;
+  }
+
+  // a solid color never changes by itself
+  virtual unsigned long nextWakeTime(const struct LEDStrip & /* strip */, unsigned int /* index */, unsigned long const &millis) const override {
+    return millis + LED_IDLE_WAKE_MS;
   }
 
   // The state data
-  virtual String toStringWithParams(unsigned long const & /* millis */) const override {
+  virtual String toStringWithParams(const struct LEDStrip & /* strip */, unsigned int /* index */, unsigned long const & /* millis */) const override {
+    const struct CHSV color = hsv();
     char ret[12];
-    sprintf(ret, "Sld %02X%02X%02X", m_color.h, m_color.s, m_color.v);
+    sprintf(ret, "Sld %02X%02X%02X", color.h, color.s, color.v);
     return String(ret);
   }
 
@@ -120,13 +187,13 @@ public:
   unsigned long const m_lifetimeMs;
   unsigned long m_expiryTimeMs;
 
-  SolidColorTimedState(const struct CHSV &hsv, int lifetimeMs) : SolidColorState(hsv), m_lifetimeMs(lifetimeMs), m_expiryTimeMs(0) {}
-  SolidColorTimedState(const struct CRGB &rgb, int lifetimeMs) : SolidColorTimedState(rgb2hsv_approximate(rgb), lifetimeMs) {}
+  SolidColorTimedState(const struct CRGB &rgb, int lifetimeMs) : SolidColorState(rgb), m_lifetimeMs(lifetimeMs), m_expiryTimeMs(0) {}
+  SolidColorTimedState(const struct CHSV &hsv, int lifetimeMs) : SolidColorTimedState(toRGB(hsv), lifetimeMs) {}
 
   // The state data
-  virtual String toStringWithParams(unsigned long const &millis) const override {
+  virtual String toStringWithParams(const struct LEDStrip & /* strip */, unsigned int /* index */, unsigned long const &millis) const override {
     char ret[12];
-    sprintf(ret, "Slt %02X %03d", m_color.h, (int)((m_expiryTimeMs - millis) % 1000));
+    sprintf(ret, "Slt %02X %03d", hsv().h, (int)((m_expiryTimeMs - millis) % 1000));
     return String(ret);
   }
 
@@ -136,43 +203,45 @@ public:
   }
 
   // observe the expiry clock
-  virtual bool isExpired(unsigned long const &millis) const override {
+  virtual bool isExpired(const struct LEDStrip & /* strip */, unsigned long const &millis) const override {
     return m_expiryTimeMs < millis;
   }
+
+  // wake up at the first moment we are expired
+  virtual unsigned long nextWakeTime(const struct LEDStrip & /* strip */, unsigned int /* index */, unsigned long const & /* millis */) const override {
+    return m_expiryTimeMs + 1;
+  }
 };
 
-// abstract class to handle flashing; both the on and off flash states are children of this
+// abstract class to handle flashing; both the on and off flash states are children of this.
+// the timing comes from the strip's flash clock, so every flashing LED is in step
 class FlashState : public SolidColorState {
 public:
-  unsigned long m_startTime; // this is the timing seed for the flashing
-
   // same constructor as a solid color
-  FlashState(const struct CHSV &hsv): SolidColorState(hsv), m_startTime(0) {}
-  FlashState(const struct CRGB &rgb): FlashState(rgb2hsv_approximate(rgb)) {}
+  FlashState(const struct CRGB &rgb): SolidColorState(rgb) {}
+  FlashState(const struct CHSV &hsv): FlashState(toRGB(hsv)) {}
 
   // or just copy what's in an existing solid color state
-  FlashState(SolidColorState const &s) : FlashState(s.m_color) {}
+  FlashState(SolidColorState const &s) : FlashState(s.m_rgb) {}
 
-  // explicit function to modify the start time for the flash
-  inline void setStartTime(unsigned long startTime) {
-    m_startTime = startTime;
+  // state is expired when the flash clock is not in the desired half
+  virtual bool isExpired(const struct LEDStrip &strip, unsigned long const & /* millis */) const override {
+    return activeOnFirstHalf() != strip.flash.firstHalf;
   }
 
-  // state is expired when the flash period is not in the desired half
-  virtual bool isExpired(unsigned long const &millis) const override {
-    const int elapsedTime = millis - m_startTime;
-    const int totalTime = FLASH_DURATION_MS * 2;
-    // mod the time that the flash mode has been active by the flash period and determine which half we're in
-    return activeOnFirstHalf() != ((elapsedTime % totalTime) < FLASH_DURATION_MS);
+  // wake up when the flash switches halves
+  virtual unsigned long nextWakeTime(const struct LEDStrip &strip, unsigned int /* index */, unsigned long const & /* millis */) const override {
+    return strip.flash.nextEdge;
   }
 
   // whether this state should be considered active in the first half of the flash
   virtual bool activeOnFirstHalf() const = 0;
 
   // The state data
-  virtual String toStringWithParams(unsigned long const & /* millis */) const override {
+  virtual String toStringWithParams(const struct LEDStrip & /* strip */, unsigned int /* index */, unsigned long const & /* millis */) const override {
+    const struct CHSV color = hsv();
     char ret[12];
-    sprintf(ret, "Fl%c %02X%02X%02X", (activeOnFirstHalf() ? '1' : '2'), m_color.h, m_color.s, m_color.v);
+    sprintf(ret, "Fl%c %02X%02X%02X", (activeOnFirstHalf() ? '1' : '2'), color.h, color.s, color.v);
     return String(ret);
   }
 };
@@ -180,9 +249,9 @@ public:
 // the "loud" period of a flash - when the flashing light is on
 class FlashLoudState : public FlashState {
 public:
+  FlashLoudState(const struct CRGB &rgb) : FlashState(rgb) {}
   FlashLoudState(const struct CHSV &hsv) : FlashState(hsv) {}
-  FlashLoudState(const struct CRGB &rgb) : FlashLoudState(rgb2hsv_approximate(rgb)) {}
-  FlashLoudState(SolidColorState const &s) : FlashLoudState(s.m_color) {}
+  FlashLoudState(SolidColorState const &s) : FlashState(s) {}
   virtual bool activeOnFirstHalf() const { return true; }
 };
 
@@ -191,97 +260,176 @@ public:
 // that would make it appear always-on
 class FlashQuietState : public FlashState {
 public:
+  FlashQuietState(const struct CRGB &rgb) : FlashState(rgb) {}
   FlashQuietState(const struct CHSV &hsv) : FlashState(hsv) {}
-  FlashQuietState(const struct CRGB &rgb) : FlashQuietState(rgb2hsv_approximate(rgb)) {}
-  FlashQuietState(SolidColorState const &s) : FlashQuietState(s.m_color) {}
+  FlashQuietState(SolidColorState const &s) : FlashState(s) {}
   virtual bool activeOnFirstHalf() const { return false; }
 };
 
 // based on time and the LED index, rotate through the rainbow
 class RainbowState : public LEDState {
 public:
-  const int m_numLEDs; // the number of LEDs in the whole strip
-  const int m_index;   // the index of this LED within the strip
-
-  RainbowState(int numLEDs, int index) : LEDState(), m_numLEDs(numLEDs), m_index(index) {}
+  RainbowState() : LEDState() {}
 
   // get the hue as a function of time
-  inline int hue(unsigned long const &millis) const {
-    return ((millis / 5) + (m_index * (255 / m_numLEDs))) % 255;
+  static inline int hue(const struct LEDStrip &strip, unsigned int index, unsigned long const &millis) {
+    return ((millis / 5) + (index * (255 / strip.numLEDs))) % 255;
+  }
+
+  virtual void loop(const struct LEDStrip &strip, unsigned int index, unsigned long const &millis) override {
+    strip.leds[index] = CHSV(hue(strip, index, millis), 255, 255);
   }
 
-  virtual void loop(struct CRGB* led, unsigned long const &millis) override {
-    *led = CHSV(hue(millis), 255, 255);
+  // the hue moves every 5ms
+  virtual unsigned long nextWakeTime(const struct LEDStrip & /* strip */, unsigned int /* index */, unsigned long const &millis) const override {
+    return ((millis / 5) + 1) * 5;
+  }
+
+  // fill the whole strip.  the time and spacing terms are the same for every LED, so
+  // the hue just steps along the strip.  returns when the strip next needs to be rendered
+  unsigned long render(const struct LEDStrip &strip, unsigned long const &millis) const {
+    const unsigned int step = 255 / strip.numLEDs;
+    unsigned int h = (millis / 5) % 255;
+    for (unsigned int i = 0; i < strip.numLEDs; ++i) {
+      strip.leds[i] = CHSV(h, 255, 255);
+      h += step;
+      if (h >= 255) h -= 255;
+    }
+    return ((millis / 5) + 1) * 5;
   }
 
   // The state data
-  virtual String toStringWithParams(unsigned long const & millis) const override {
+  virtual String toStringWithParams(const struct LEDStrip &strip, unsigned int index, unsigned long const & millis) const override {
     char ret[12];
-    sprintf(ret, "Rnb    %03d", hue(millis));
+    sprintf(ret, "Rnb    %03d", hue(strip, index, millis));
     return String(ret);
   }
 };
 
-// Flash briefly and then wait a random amount of time.  Taken together, it's sparkly
+// Flash briefly at a pseudorandom time.  Taken together, it's sparkly
+//
+// Time is cut into windows, and each LED flashes once per window at an offset that's
+// a hash of its index and the window number.  So there's nothing to remember per LED.
 class SparkleState : public LEDState {
 public:
-  unsigned long m_canFlashMs;
   const unsigned int m_sparkleDurationMs = 20;
+  const unsigned int m_windowMs = m_sparkleDurationMs + (FLASH_DURATION_MS * 3);
 
-  SparkleState() : LEDState(), m_canFlashMs(0) {}
+  SparkleState() : LEDState() {}
+
+  // scramble the index and window number into a flash offset
+  static inline uint16_t hash(unsigned int index, unsigned long window) {
+    uint16_t h = (uint16_t)(window * 40503u) ^ (uint16_t)((index + 1) * 9973u);
+    h ^= h >> 7;
+    h = (uint16_t)(h * 0x2F1Du);
+    h ^= h >> 9;
+    return h;
+  }
+
+  // when the given LED flashes in the window that contains the given time
+  inline unsigned long flashTime(unsigned int index, unsigned long const &millis) const {
+    const unsigned long window = millis / m_windowMs;
+    return (window * m_windowMs) + (hash(index, window) % (m_windowMs - m_sparkleDurationMs));
+  }
 
   // on-time is in the future
-  inline bool beforeFlash(unsigned long const &millis) const {
-    return millis < m_canFlashMs;
+  inline bool beforeFlash(unsigned int index, unsigned long const &millis) const {
+    return millis < flashTime(index, millis);
   }
 
   // on-time and off-time have both elapsed
-  inline bool afterFlash(unsigned long const &millis) const {
-    return (m_canFlashMs + m_sparkleDurationMs) < millis;
+  inline bool afterFlash(unsigned int index, unsigned long const &millis) const {
+    return (flashTime(index, millis) + m_sparkleDurationMs) <= millis;
   }
 
-  // before the pulse, go dark. during the pulse, go light. after the pulse, pick a new pulse time.
-  virtual void loop(struct CRGB* led, unsigned long const &millis) override {
-    if (beforeFlash(millis)) {
-      *led = COLOR_BLACK;
-    } else if (afterFlash(millis)) {
-      m_canFlashMs = millis + m_sparkleDurationMs + random(FLASH_DURATION_MS * 5);
-    } else {
-      *led = COLOR_WHITE;
+  // outside the pulse, go dark. during the pulse, go light.
+  virtual void loop(const struct LEDStrip &strip, unsigned int index, unsigned long const &millis) override {
+    const unsigned long canFlash = flashTime(index, millis);
+    const bool flashing = canFlash <= millis && millis < canFlash + m_sparkleDurationMs;
+    strip.leds[index] = flashing ? COLOR_WHITE : COLOR_BLACK;
+  }
+
+  // wake up for the start of the pulse, for the end of it, or for the next window
+  virtual unsigned long nextWakeTime(const struct LEDStrip & /* strip */, unsigned int index, unsigned long const &millis) const override {
+    const unsigned long canFlash = flashTime(index, millis);
+    if (millis < canFlash) return canFlash;
+    if (millis < canFlash + m_sparkleDurationMs) return canFlash + m_sparkleDurationMs;
+    return ((millis / m_windowMs) + 1) * m_windowMs;
+  }
+
+  // fill the whole strip.  every LED shares the same window, so only the hash is per-LED.
+  // returns when the strip next needs to be rendered: the soonest flash edge of any LED
+  unsigned long render(const struct LEDStrip &strip, unsigned long const &millis) const {
+    const unsigned long window = millis / m_windowMs;
+    const unsigned long windowStart = window * m_windowMs;
+    const unsigned int spread = m_windowMs - m_sparkleDurationMs;
+    unsigned long soonest = windowStart + m_windowMs;
+    for (unsigned int i = 0; i < strip.numLEDs; ++i) {
+      const unsigned long canFlash = windowStart + (hash(i, window) % spread);
+      const unsigned long stopFlash = canFlash + m_sparkleDurationMs;
+      if (millis < canFlash) {
+        strip.leds[i] = COLOR_BLACK;
+        if (canFlash < soonest) soonest = canFlash;
+      } else if (millis < stopFlash) {
+        strip.leds[i] = COLOR_WHITE;
+        if (stopFlash < soonest) soonest = stopFlash;
+      } else {
+        strip.leds[i] = COLOR_BLACK;
+      }
     }
+    return soonest;
   }
 
   // The state data
-  virtual String toStringWithParams(unsigned long const & millis) const override {
+  virtual String toStringWithParams(const struct LEDStrip & /* strip */, unsigned int index, unsigned long const & millis) const override {
     char ret[12];
-    if (beforeFlash(millis)) {
-      sprintf(ret, "Sprk  %04ld", m_canFlashMs - millis);
-    } else if (afterFlash(millis)) {
+    if (beforeFlash(index, millis)) {
+      sprintf(ret, "Sprk  %04ld", flashTime(index, millis) - millis);
+    } else if (afterFlash(index, millis)) {
       sprintf(ret, "SPRK  ----");
     } else {
-      sprintf(ret, "SPRK  %04ld", m_canFlashMs + m_sparkleDurationMs - millis);
+      sprintf(ret, "SPRK  %04ld", flashTime(index, millis) + m_sparkleDurationMs - millis);
     }
 
     return String(ret);
   }
 };
 
+// The shape of the shimmer's brightness falloff: 255 - (distance * distanceFactor)^2 reaches 0 at
+// distance sqrt(255) / distanceFactor.  Relative to that distance, the curve is always the same,
+// so it's tabulated once here and each ShimmerState only keeps the scale of its distance factor.
+const unsigned int SHIMMER_FALLOFF_STEPS = 16;
+const uint16_t SHIMMER_FALLOFF[SHIMMER_FALLOFF_STEPS + 1] = { // in 1/256ths
+  65280, 65025, 64260, 62985, 61200, 58905, 56100, 52785, 48960,
+  44625, 39780, 34425, 28560, 22185, 15300,  7905,     0
+};
+
+// a precomputed shimmer lineOffset that didn't fit
+const int16_t SHIMMER_OFFSET_UNKNOWN = INT16_MIN;
+
 // Simulate a position-based shimmer of the LEDs
 //
 // We will sweep an imaginary line across the LEDs in-situ, and based on their
 // distance to that imaginary line, we will light them proprotionally.
+// The line is the same for every LED, so one of these serves the whole strip.
+//
+// This is all integer math, since floating point is very slow on the AVR.  The slope and the
+// normalization of the distance formula are converted to fixed point at construction (the only
+// place that uses floating point), and each LED's "m*x - y" is constant and can be precomputed
+// into the strip's lineOffsets.  Only the height of the line changes from frame to frame.
 class ShimmerState : public LEDState {
 public:
-  const struct LEDPosition m_pos;
   const unsigned int m_shimmerDurationMs;  // this is how long we want the effect to take
-  const float m_distanceFactor;            // the bigger this is, the narrower the shimmer
   const unsigned int m_shimmerSpeedFactor; // the bigger this is, the faster the shimmer goes across
   const long m_initialHeight;              // the higher this is (negative scale), the longer the line takes to reach the LEDs
-  const float m_slope;                     // the slope of the imaginary line
+  const long m_slopeQ8;                    // the slope of the imaginary line, in 1/256ths
+  const unsigned long m_invNormQ16;        // 1 / sqrt(slope^2 + 1), in 1/65536ths
+  const unsigned long m_falloffRange;      // the distance at which the LED goes dark
+  const unsigned long m_falloffScaleQ16;   // SHIMMER_FALLOFF steps per unit distance, in 1/65536ths
 
-  // full featured constructor, for unit testing
+  // full featured constructor, for unit testing.
+  // distanceFactor: the bigger this is, the narrower the shimmer
   ShimmerState(
-    const struct LEDPosition pos,
     unsigned int shimmerDurationMs,
     float distanceFactor,
     unsigned int shimmerSpeedFactor,
@@ -289,23 +437,30 @@ public:
     double slope
   ) :
     LEDState(),
-    m_pos(pos),
     m_shimmerDurationMs(shimmerDurationMs),
-    m_distanceFactor(distanceFactor),
     m_shimmerSpeedFactor(shimmerSpeedFactor),
     m_initialHeight(initialHeight),
-    m_slope(slope)
+    m_slopeQ8(lround(slope * 256)),
+    m_invNormQ16(lround(65536 / sqrt((slope * slope) + 1))),
+    m_falloffRange(distanceFactor > 0 ? (unsigned long)ceil(sqrt(255) / distanceFactor) : 0xFFFFFFFF),
+    m_falloffScaleQ16(lround(distanceFactor * SHIMMER_FALLOFF_STEPS * 65536 / sqrt(255)))
   {}
 
   // minimal constructor with actual defaults in use
-  ShimmerState(const struct LEDPosition pos) : ShimmerState(pos, 6500, 0.025, 8, -6000, 1) {}
+  ShimmerState() : ShimmerState(6500, 0.025, 8, -6000, 1) {}
   // Slow motion for testing
-  // ShimmerState(const struct LEDPosition pos) : ShimmerState(pos, 65000, 0.025, 1, -4000, 1) {}
+  // ShimmerState() : ShimmerState(65000, 0.025, 1, -4000, 1) {}
 
   // this defines how sharply the brightness falls off with distance.
-  // we're using an inverse square law here.
+  // we're using an inverse square law here, interpolated from the SHIMMER_FALLOFF table
   inline unsigned int velVsDistance(unsigned long const &distance) const {
-    return max(0, 255 - pow(distance * m_distanceFactor, 2));
+    if (distance >= m_falloffRange) return 0;
+    const unsigned long step = distance * m_falloffScaleQ16;
+    const unsigned int i = step >> 16;
+    if (i >= SHIMMER_FALLOFF_STEPS) return 0;
+    const unsigned long fraction = (step >> 8) & 0xFF;
+    const unsigned long drop = SHIMMER_FALLOFF[i] - SHIMMER_FALLOFF[i + 1];
+    return (SHIMMER_FALLOFF[i] - ((drop * fraction) >> 8)) >> 8;
   }
 
   // control the sweep of the imaginary line
@@ -313,39 +468,145 @@ public:
     return (((millis - m_activationTimeMs) % m_shimmerDurationMs) * m_shimmerSpeedFactor);
   }
 
+  // the height of the imaginary line at the given time
+  inline long lineHeight(unsigned long const &millis) const {
+    return m_initialHeight + animationPosition(millis);
+  }
+
+  // the part of the distance formula that only depends on the LED: m*x - y, to the nearest unit
+  inline long lineOffset(const struct LEDPosition &pos) const {
+    return (((m_slopeQ8 * (long)pos.x) + 0x80) >> 8) - (long)pos.y;
+  }
+
+  // fill in the lineOffset of every LED on the strip.  with a steep enough slope, an offset
+  // won't fit in 16 bits; that LED is marked SHIMMER_OFFSET_UNKNOWN, and worked out each time
+  void precompute(const struct LEDStrip &strip) const {
+    for (unsigned int i = 0; i < strip.numLEDs; ++i) {
+      const long offset = lineOffset(strip.positions[i]);
+      strip.lineOffsets[i] = (offset <= SHIMMER_OFFSET_UNKNOWN || INT16_MAX < offset) ? SHIMMER_OFFSET_UNKNOWN : (int16_t)offset;
+    }
+  }
+
+  // the distance from an LED (by its lineOffset) to the line (by its height).
+  // far-away distances saturate, which keeps the multiplication within 32 bits -- they're dark anyway
+  inline unsigned long distanceFromOffset(long offset, long height) const {
+    unsigned long numerator = labs(offset + height);
+    if (numerator > 0xFFFF) numerator = 0xFFFF;
+    return (numerator * m_invNormQ16) >> 16;
+  }
+
   // imaginary line moves with respect to time, from low X to high X
-  inline unsigned long linearDistance(unsigned long const &millis) const {
-    return abs(2000 + m_pos.x - animationPosition(millis));
+  inline unsigned long linearDistance(const struct LEDPosition &pos, unsigned long const &millis) const {
+    return labs(2000 + (long)pos.x - animationPosition(millis));
   }
 
   // Imaginary line with a slope moves from high Y to low Y, but considers M and X
-  inline unsigned long distanceToLine(unsigned long const &millis) const {
-    const double m(m_slope);
-    long b = m_initialHeight + animationPosition(millis);
-
-    // https://en.wikipedia.org/wiki/Distance_from_a_point_to_a_line
-    return abs((m * m_pos.x) - m_pos.y + b) / sqrt((m * m_slope) + 1);
+  // https://en.wikipedia.org/wiki/Distance_from_a_point_to_a_line
+  inline unsigned long distanceToLine(const struct LEDPosition &pos, unsigned long const &millis) const {
+    return distanceFromOffset(lineOffset(pos), lineHeight(millis));
   }
 
   // get the vel as a function of time, which in turn is a function of distnace to imaginary line
-  inline unsigned int vel(unsigned long const &millis) const {
-    //return velVsDistance(linearDistance(millis));
-    return velVsDistance(distanceToLine(millis));
+  inline unsigned int vel(const struct LEDPosition &pos, unsigned long const &millis) const {
+    //return velVsDistance(linearDistance(pos, millis));
+    return velVsDistance(distanceToLine(pos, millis));
   }
 
-  // before the pulse, go dark. during the pulse, go light. after the pulse, pick a new pulse time.
-  virtual void loop(struct CRGB* led, unsigned long const &millis) override {
-    *led = CHSV(0, 0, vel(millis));
+  // the lineOffset of an LED on the strip, precomputed if possible
+  inline long lineOffset(const struct LEDStrip &strip, unsigned int index) const {
+    if (strip.lineOffsets && strip.lineOffsets[index] != SHIMMER_OFFSET_UNKNOWN) return strip.lineOffsets[index];
+    return lineOffset(strip.positions[index]);
+  }
+
+  // light the LED according to how close the line is to it
+  virtual void loop(const struct LEDStrip &strip, unsigned int index, unsigned long const &millis) override {
+    strip.leds[index] = CHSV(0, 0, velVsDistance(distanceFromOffset(lineOffset(strip, index), lineHeight(millis))));
+  }
+
+  // fill the whole strip.  the line's height is the same for every LED, so it's worked out once.
+  // returns when the strip next needs to be rendered
+  unsigned long render(const struct LEDStrip &strip, unsigned long const &millis) const {
+    const long height = lineHeight(millis);
+    for (unsigned int i = 0; i < strip.numLEDs; ++i) {
+      strip.leds[i] = CHSV(0, 0, velVsDistance(distanceFromOffset(lineOffset(strip, i), height)));
+    }
+    return millis + 1;
   }
 
   // The state data
-  virtual String toStringWithParams(unsigned long const & millis) const override {
+  virtual String toStringWithParams(const struct LEDStrip & /* strip */, unsigned int /* index */, unsigned long const & millis) const override {
     char ret[12];
     sprintf(ret, "Shim  %04ld", millis % m_shimmerDurationMs);
     return String(ret);
   }
 };
 
+// The states for the effects that take over the whole strip.
+//
+// None of them keep any data per LED, so a single set of them is shared by every LED
+// on the strip (flyweights) instead of each LED carrying its own copies.
+//
+// Each effect can also render the whole strip in one pass, working out the terms that are
+// the same for every LED only once per frame.  While an effect is active, that's what the
+// strip should use instead of asking each LED's state machine.
+struct GlobalEffects {
+  RainbowState rainbow;
+  SparkleState sparkle;
+  ShimmerState shimmer;
+
+  EffectMode::Values active;    // the effect that was rendered last
+  unsigned long nextRenderTime; // when the active effect needs to be rendered again
+  unsigned long frames;         // how many whole-strip renders have been done
+
+  GlobalEffects() { reset(); }
+
+  // stop any effect
+  void reset() {
+    active = EffectMode::Values::none;
+    nextRenderTime = 0;
+    frames = 0;
+  }
+
+  // render the given effect across the whole strip, if it's due.
+  // returns whether an effect owns the strip, i.e. whether the LEDs' own states should be skipped
+  bool render(const struct LEDStrip &strip, EffectMode::Values mode, unsigned long const &millis) {
+    if (mode == EffectMode::Values::none) {
+      active = mode;
+      return false;
+    }
+
+    if (mode != active) {
+      active = mode;
+      nextRenderTime = millis;
+      if (mode == EffectMode::Values::shimmer) shimmer.activate(millis);
+    }
+
+    if ((long)(millis - nextRenderTime) < 0) return true;
+
+    switch (mode) {
+    case EffectMode::Values::rainbow:
+      nextRenderTime = rainbow.render(strip, millis);
+      break;
+    case EffectMode::Values::sparkle:
+      nextRenderTime = sparkle.render(strip, millis);
+      break;
+    default:
+      nextRenderTime = shimmer.render(strip, millis);
+      break;
+    }
+    ++frames;
+    return true;
+  }
+
+  // summary of the effect rendering
+  String toString() const {
+    char ret[16];
+    sprintf(ret, "fx %d %lu", (int)active, frames);
+    return String(ret);
+  }
+};
+
+
 ////////////////////////////////////////////////////////////////////
 //
 // LED Behavior Types
@@ -357,20 +618,23 @@ public:
 // This class defines an LED that can be in one of several states.
 // The states must be defined as member variables, and a chooseNextState function
 //   chooses which state to point to when it is time to find the next one.
+//
+// The Behavior parameter is the final class itself (e.g. "class AirCondLED final : public
+// SimpleLED<AirCondLED>"), so calls to chooseNextState, name, etc are resolved at compile
+// time instead of through a vtable.  Only the LEDStates are polymorphic, since which state
+// an LED is in really is a runtime decision.
+//
+// The LED doesn't store where it is; the strip and its index are passed in on every call.
+template <typename Behavior>
 class StatefulLED {
 public:
   LEDState* m_currentState;
-  struct CRGB* const m_leds; // the pointer is const, but the struct is not
-  const int m_numLEDs; // the number of LEDs in the whole strip
-  const int m_index;   // the index of this LED within the strip, 0-indexed
-
-  // construct with the LEDs structure (used by fastLED), the total number of LEDs, and the index into the array
-  StatefulLED(struct CRGB* leds, const struct LEDPosition* ledPosition, int numLEDs, int index) :
-    m_currentState(nullptr),
-    m_leds(leds),
-    m_numLEDs(numLEDs),
-    m_index(index)
-  {}
+
+  StatefulLED() : m_currentState(nullptr) {}
+
+  // the concrete LED that we are
+  inline Behavior& behavior() { return *static_cast<Behavior*>(this); }
+  inline const Behavior& behavior() const { return *static_cast<const Behavior*>(this); }
 
   // shortcut to ask if we are in a given state
   inline bool inState(LEDState const &state) const {
@@ -382,167 +646,314 @@ public:
     return nullptr == m_currentState;
   }
 
-  // what state to pick next
-  virtual LEDState* chooseNextState(unsigned long const &millis, const SlaveState &slave) = 0;
-
-  // string representation of the state name
-  virtual String name() const = 0;
+  // the inputs that chooseNextState reads.  the LED won't be reevaluated for changes in anything else
+  static inline LEDInputMask inputMask() { return LED_INPUT_NONE; }
 
   // string representation
-  virtual String toString(unsigned long const &millis) const {
+  String toString(const struct LEDStrip &strip, unsigned int index, unsigned long const &millis) const {
     if (inInitialState()) {
       return "[Initial]";
     }
 
     char ret[40];
-    sprintf(ret, "[%4s %13s]", name().c_str(), m_currentState->toString(millis).c_str());
+    sprintf(ret, "[%4s %13s]", behavior().name().c_str(), m_currentState->toString(strip, index, millis).c_str());
     return String(ret);
   }
 
   // on each iteation, check if the state has expired and activate the next one if so
-  void loop(unsigned long const &millis, const SlaveState &slave) {
-    if (inInitialState() || m_currentState->isExpired(millis)) {
-      LEDState* newState = chooseNextState(millis, slave);
+  void loop(const struct LEDStrip &strip, unsigned int index, unsigned long const &millis, const SlaveState &slave) {
+    if (inInitialState() || m_currentState->isExpired(strip, millis)) {
+      LEDState* newState = behavior().chooseNextState(strip, millis, slave);
       if (newState != m_currentState) {
         m_currentState = newState;
         m_currentState->activate(millis);
       }
     }
 
-    m_currentState->loop(m_leds + m_index, millis); // "m_leds + index" is just "&m_leds[index]"
+    m_currentState->loop(strip, index, millis);
+  }
+
+  // the next time this LED needs a loop(), assuming its inputs don't change in the meantime
+  inline unsigned long nextWakeTime(const struct LEDStrip &strip, unsigned int index, unsigned long const &millis) const {
+    return inInitialState() ? millis : m_currentState->nextWakeTime(strip, index, millis);
+  }
+};
+
+
+// One entry in the description of a strip: which behavior sits at which index
+template <typename Behavior, unsigned int Index>
+struct LEDSlot {
+  typedef Behavior type;
+  static const unsigned int index = Index;
+};
+
+// Statically typed storage for every LED on a strip, generated from a list of LEDSlots.
+//
+// Each slot's LED is a plain member (well, a base) of the layout, so there's no heap
+// allocation and no vtable for the LEDs.  To do something to every LED, pass a visitor with
+// a templated visit(led, index) function; each call is resolved at compile time for that LED's type.
+//
+// The slots must be listed in strip order, starting from 0; this is checked at compile time.
+template <unsigned int Position, typename... Slots>
+struct LEDLayoutFrom;
+
+// the end of the list
+template <unsigned int Position>
+struct LEDLayoutFrom<Position> {
+  static const unsigned int size = 0;
+
+  template <typename Visitor> inline void visit(Visitor & /* v */) {}
+  template <typename Visitor> inline void visit(Visitor & /* v */) const {}
+
+  inline LEDInputMask inputMask(unsigned int /* index */) const { return LED_INPUT_NONE; }
+};
+
+template <unsigned int Position, typename Slot, typename... Rest>
+struct LEDLayoutFrom<Position, Slot, Rest...> : public LEDLayoutFrom<Position + 1, Rest...> {
+  typedef LEDLayoutFrom<Position + 1, Rest...> Next;
+  static_assert(Slot::index == Position, "LED slots must be listed in strip order");
+
+  static const unsigned int size = 1 + Next::size;
+
+  typename Slot::type led;
+
+  // apply the visitor to every LED, in strip order
+  template <typename Visitor> inline void visit(Visitor &v) {
+    v.visit(led, Slot::index);
+    Next::visit(v);
+  }
+
+  template <typename Visitor> inline void visit(Visitor &v) const {
+    v.visit(led, Slot::index);
+    Next::visit(v);
+  }
+
+  // the inputs subscribed to by the LED at a given index
+  inline LEDInputMask inputMask(unsigned int index) const {
+    return index == Position ? Slot::type::inputMask() : Next::inputMask(index);
   }
 };
 
+// the layout of a strip, starting at index 0
+template <typename... Slots>
+using LEDLayout = LEDLayoutFrom<0, Slots...>;
+
+// a visitor that appends the state of each LED to a string, 7 to a line
+struct LEDDescription {
+  String &ret;
+  const struct LEDStrip &strip;
+  unsigned long const &millis;
 
-// All Binky LEDs respond to global modes (like rainbow)
+  template <typename LED>
+  inline void visit(const LED &led, unsigned int index) {
+    ret.concat(index % 7 == 0 ? "\n" : " ");
+    ret.concat(led.toString(strip, index, millis));
+  }
+};
+
+
+// Keep track of when each of a set of stateful LEDs next needs to be looked at.
+//
+// Most LEDs on the dash sit in a solid color for minutes at a time, so rather than
+// calling loop() on every LED on every tick, each LED reports when its state will next
+// do something on its own.  Then only the LEDs that are due get a loop() -- along with
+// the LEDs that subscribe to an input that has changed.
+//
+// Times are compared by their signed difference so that the millis() rollover is harmless.
+template <unsigned int NumLEDs>
+struct LEDSchedule {
+  unsigned long wakeTime[NumLEDs]; // when each LED is due
+  unsigned long earliestWakeTime;  // the soonest of all of the above
+  unsigned long evaluations;       // how many LED loop()s have been performed
+
+  LEDSchedule() { reset(0); }
+
+  // make every LED due at the given time
+  void reset(unsigned long const &millis) {
+    for (unsigned int i = 0; i < NumLEDs; ++i) wakeTime[i] = millis;
+    earliestWakeTime = millis;
+    evaluations = 0;
+  }
+
+  // whether a time has been reached
+  static inline bool reached(unsigned long const &when, unsigned long const &millis) {
+    return (long)(millis - when) >= 0;
+  }
+
+  // whether a particular LED is due
+  inline bool isDue(unsigned int index, unsigned long const &millis) const {
+    return reached(wakeTime[index], millis);
+  }
+
+  // whether any LED is due
+  inline bool anyDue(unsigned long const &millis) const {
+    return reached(earliestWakeTime, millis);
+  }
+
+  // the visitor that does the work of loop() for each LED in a layout
+  struct Pass {
+    LEDSchedule* schedule;
+    const struct LEDStrip &strip;
+    LEDInputMask changedInputs;
+    unsigned long const &millis;
+    const SlaveState &slave;
+    unsigned long soonest;
+
+    template <typename LED>
+    inline void visit(LED &led, unsigned int i) {
+      if (schedule->isDue(i, millis) || (changedInputs & LED::inputMask())) {
+        led.loop(strip, i, millis, slave);
+        schedule->wakeTime[i] = led.nextWakeTime(strip, i, millis);
+        ++schedule->evaluations;
+      }
+      if ((long)(schedule->wakeTime[i] - soonest) < 0) soonest = schedule->wakeTime[i];
+    }
+  };
+
+  // loop() the LEDs that are due or whose inputs have changed, and reschedule them
+  template <typename Layout>
+  void loop(Layout &layout, const struct LEDStrip &strip, LEDInputMask changedInputs, unsigned long const &millis, const SlaveState &slave) {
+    static_assert(Layout::size == NumLEDs, "The schedule and the layout must cover the same LEDs");
+    if (!changedInputs && !anyDue(millis)) return;
+
+    Pass pass = { this, strip, changedInputs, millis, slave, millis + LED_IDLE_WAKE_MS };
+    layout.visit(pass);
+    earliestWakeTime = pass.soonest;
+  }
+};
+
+
+// All Binky LEDs respond to global modes (like rainbow), using the strip's shared effect states.
 // The local states must be defined as member variables, and a chooseNextLocalState function
 //   chooses which state to point to when it is time to find the next one.  This ensures
 //   we only need to handle global behaviors here.
-class BinkyLED : public StatefulLED {
+template <typename Behavior>
+class BinkyLED : public StatefulLED<Behavior> {
 public:
-  SolidColorTimedState m_stOn;
-  SolidColorState m_stOff;
-  RainbowState m_stRainbow;
-  SparkleState m_stSparkle;
-  ShimmerState m_stShimmer;
-
-  BinkyLED(struct CRGB* leds, const struct LEDPosition* ledPosition, int numLEDs, int index) :
-    StatefulLED(leds, ledPosition, numLEDs, index),
-    m_stOn(COLOR_WHITE, FLASH_DURATION_MS / 10),
-    m_stOff(COLOR_BLACK),
-    m_stRainbow(numLEDs, index),
-    m_stSparkle(),
-    m_stShimmer(ledPosition[index])
-  {}
-
   // the master signal for rainbow modes override all others because they work as a group
-  virtual LEDState* chooseNextState(unsigned long const &millis, const SlaveState &slave) {
+  LEDState* chooseNextState(const struct LEDStrip &strip, unsigned long const &millis, const SlaveState &slave) {
     switch (slave.effectmode.state) {
     case EffectMode::Values::rainbow:
-      return &m_stRainbow;
+      return &strip.effects->rainbow;
     case EffectMode::Values::sparkle:
-      return &m_stSparkle;
+      return &strip.effects->sparkle;
     case EffectMode::Values::shimmer:
-      return &m_stShimmer;
+      return &strip.effects->shimmer;
     default:
-      return chooseNextLocalState(millis, slave);
+      return this->behavior().chooseNextLocalState(strip, millis, slave);
     }
   }
 
-  // what state to pick next
-  virtual LEDState* chooseNextLocalState(unsigned long const &millis, const SlaveState &slave) = 0;
+  // all binky LEDs respond to the global effect mode
+  static inline LEDInputMask inputMask() { return ledInputOf(LEDInput::Values::effectMode); }
 };
 
 // A simple LED switches between a solid color mode (on/off) and a rainbow mode
 // the on/off criteria can be overridden
-class SimpleLED : public BinkyLED {
+template <typename Behavior>
+class SimpleLED : public BinkyLED<Behavior> {
 public:
   SolidColorState m_stOff;
   SolidColorState m_stOn;
 
-  SimpleLED(struct CRGB* leds, const struct LEDPosition* ledPosition, int numLEDs, int index, const struct CHSV &color) :
-    BinkyLED(leds, ledPosition, numLEDs, index),
+  SimpleLED(const struct CRGB &color) :
+    BinkyLED<Behavior>(),
     m_stOff(COLOR_BLACK),
     m_stOn(color)
   {}
 
-  SimpleLED(struct CRGB* leds, const struct LEDPosition* ledPosition, int numLEDs, int index, const struct CRGB &color) :
-    SimpleLED(leds, ledPosition, numLEDs, index, rgb2hsv_approximate(color))
-  {}
+  SimpleLED(const struct CHSV &color) : SimpleLED(toRGB(color)) {}
 
   // the master signal for rainbow mode overrides all others
-  virtual LEDState* chooseNextLocalState(unsigned long const &millis, const SlaveState &slave) {
-    return isOn(millis, slave) ? &m_stOn : &m_stOff;
+  LEDState* chooseNextLocalState(const struct LEDStrip & /* strip */, unsigned long const &millis, const SlaveState &slave) {
+    return this->behavior().isOn(millis, slave) ? &m_stOn : &m_stOff;
   }
 
   // by default, always on
-  virtual bool isOn(unsigned long const & /* millis */, const SlaveState & /* slave */) { return true; }
+  inline bool isOn(unsigned long const & /* millis */, const SlaveState & /* slave */) const { return true; }
 };
 
 // an illumination LED is the "vanilla" tone of the whole dash
-class IlluminationLED : public SimpleLED {
+class IlluminationLED final : public SimpleLED<IlluminationLED> {
 public:
-  IlluminationLED(struct CRGB* leds, const struct LEDPosition* ledPosition, int numLEDs, int index) : SimpleLED(leds, ledPosition, numLEDs, index, COLOR_WHITE) {}
+  IlluminationLED() : SimpleLED(COLOR_WHITE) {}
 
   // string representation of the state name
-  inline virtual String name() const override { return "Illu"; };
+  inline String name() const { return "Illu"; };
 };
 
 // control of the AC LED
-class AirCondLED : public SimpleLED {
+class AirCondLED final : public SimpleLED<AirCondLED> {
 public:
-  AirCondLED(struct CRGB* leds, const struct LEDPosition* ledPosition, int numLEDs, int index) : SimpleLED(leds, ledPosition, numLEDs, index, COLOR_BLUE) {}
+  AirCondLED() : SimpleLED(COLOR_BLUE) {}
 
   // string representation of the state name
-  inline virtual String name() const override { return "AC"; };
+  inline String name() const { return "AC"; };
 
-  virtual bool isOn(unsigned long const & /* millis */, const SlaveState &slave) override {
+  inline bool isOn(unsigned long const & /* millis */, const SlaveState &slave) const {
     return slave.getMasterSignal(MasterSignal::Values::acOn);
   }
+
+  static inline LEDInputMask inputMask() {
+    return SimpleLED::inputMask() | ledInputOf(MasterSignal::Values::acOn);
+  }
 };
 
 // control of the rear window heater LED
-class HeatedRearWindowLED : public SimpleLED {
+class HeatedRearWindowLED final : public SimpleLED<HeatedRearWindowLED> {
 public:
-  HeatedRearWindowLED(struct CRGB* leds, const struct LEDPosition* ledPosition, int numLEDs, int index) : SimpleLED(leds, ledPosition, numLEDs, index, COLOR_YELLOW) {}
+  HeatedRearWindowLED() : SimpleLED(COLOR_YELLOW) {}
 
   // string representation of the state name
-  inline virtual String name() const override { return "Hrw"; };
+  inline String name() const { return "Hrw"; };
 
-  virtual bool isOn(unsigned long const & /* millis */, const SlaveState &slave) override {
+  inline bool isOn(unsigned long const & /* millis */, const SlaveState &slave) const {
     return slave.getMasterSignal(MasterSignal::Values::heatedRearWindowOn);
   }
+
+  static inline LEDInputMask inputMask() {
+    return SimpleLED::inputMask() | ledInputOf(MasterSignal::Values::heatedRearWindowOn);
+  }
 };
 
 // control of the rear window heater LED
-class HazardLED : public SimpleLED {
+class HazardLED final : public SimpleLED<HazardLED> {
 public:
-  HazardLED(struct CRGB* leds, const struct LEDPosition* ledPosition, int numLEDs, int index) : SimpleLED(leds, ledPosition, numLEDs, index, COLOR_WHITE) {}
+  HazardLED() : SimpleLED(COLOR_WHITE) {}
 
   // string representation of the state name
-  inline virtual String name() const override { return "Haz"; };
+  inline String name() const { return "Haz"; };
 
-  virtual bool isOn(unsigned long const & /* millis */, const SlaveState &slave) override {
+  inline bool isOn(unsigned long const & /* millis */, const SlaveState &slave) const {
     return !slave.getMasterSignal(MasterSignal::Values::hazardOff);
   }
+
+  static inline LEDInputMask inputMask() {
+    return SimpleLED::inputMask() | ledInputOf(MasterSignal::Values::hazardOff);
+  }
 };
 
 // control of the rear window heater LED
-class RearFoggerLED : public SimpleLED {
+class RearFoggerLED final : public SimpleLED<RearFoggerLED> {
 public:
-  RearFoggerLED(struct CRGB* leds, const struct LEDPosition* ledPosition, int numLEDs, int index) : SimpleLED(leds, ledPosition, numLEDs, index, COLOR_AMBER) {}
+  RearFoggerLED() : SimpleLED(COLOR_AMBER) {}
 
   // string representation of the state name
-  inline virtual String name() const override { return "Fog"; };
+  inline String name() const { return "Fog"; };
 
-  virtual bool isOn(unsigned long const & /* millis */, const SlaveState &slave) override {
+  inline bool isOn(unsigned long const & /* millis */, const SlaveState &slave) const {
     return slave.getMasterSignal(MasterSignal::Values::rearFoggerOn);
   }
+
+  static inline LEDInputMask inputMask() {
+    return SimpleLED::inputMask() | ledInputOf(MasterSignal::Values::rearFoggerOn);
+  }
 };
 
 
 // This class defines a blinking LED that can blink 2 different colors
-class MultiBlinkingLED : public BinkyLED {
+template <typename Behavior>
+class MultiBlinkingLED : public BinkyLED<Behavior> {
 public:
   SolidColorState m_stSolid;
   FlashLoudState  m_stFlashRedLoud;
@@ -553,8 +964,8 @@ public:
   // note that even though the quiet states and the solid states are the same color,
   // the solid state can be interrupted at any time
 
-  MultiBlinkingLED(struct CRGB* leds, const struct LEDPosition* ledPosition, int numLEDs, int index) :
-    BinkyLED(leds, ledPosition, numLEDs, index),
+  MultiBlinkingLED() :
+    BinkyLED<Behavior>(),
     m_stSolid(COLOR_WHITE),
     m_stFlashRedLoud(COLOR_RED),
     m_stFlashRedQuiet(m_stSolid),
@@ -562,32 +973,22 @@ public:
     m_stFlashAmberQuiet(m_stSolid)
   {}
 
-  // conditionally seed the flash states' timing
-  void seedFlashTiming(unsigned long const &millis) {
-    // if we're not in one of the non-flash states, then keep the flash seed as it is.
-    // this ensures that we won't restart blinking while already blinking
-    if (inInitialState() || inState(m_stRainbow) || inState(m_stSolid)) {
-      m_stFlashRedLoud.setStartTime(millis);
-      m_stFlashRedQuiet.setStartTime(millis);
-      m_stFlashAmberLoud.setStartTime(millis);
-      m_stFlashAmberQuiet.setStartTime(millis);
-    }
+  // whether we're in one of our flash states
+  inline bool isFlashing() const {
+    return this->inState(m_stFlashRedLoud)
+      || this->inState(m_stFlashRedQuiet)
+      || this->inState(m_stFlashAmberLoud)
+      || this->inState(m_stFlashAmberQuiet);
   }
 
-  // indications for warnings and critical states
-  virtual bool isWarning(const SlaveState &slave) const = 0;
-  virtual bool isCritical(const SlaveState &slave) const = 0;
-
-  // what state to pick next
-  virtual LEDState* chooseNextLocalState(unsigned long const &millis, const SlaveState &slave) {
-    if (isCritical(slave)) {
-      seedFlashTiming(millis);
-      // loud states must transition to quiet to complete the blink. all others go loud immediately
-      return (inState(m_stFlashRedLoud) || inState(m_stFlashAmberLoud)) ? (LEDState*)&m_stFlashRedQuiet : (LEDState*)&m_stFlashRedLoud;
-    } else if (isWarning(slave)) {
-      seedFlashTiming(millis);
-      // loud states must transition to quiet to complete the blink. all others go loud immediately
-      return (inState(m_stFlashRedLoud) || inState(m_stFlashAmberLoud)) ? (LEDState*)&m_stFlashAmberQuiet : (LEDState*)&m_stFlashAmberLoud;
+  // what state to pick next.  the Behavior provides isWarning and isCritical.
+  // a flashing LED joins the strip's flash clock in whichever half it's in, so all of them blink together
+  LEDState* chooseNextLocalState(const struct LEDStrip &strip, unsigned long const & /* millis */, const SlaveState &slave) {
+    const bool loud = strip.flash.firstHalf;
+    if (this->behavior().isCritical(slave)) {
+      return loud ? (LEDState*)&m_stFlashRedLoud : (LEDState*)&m_stFlashRedQuiet;
+    } else if (this->behavior().isWarning(slave)) {
+      return loud ? (LEDState*)&m_stFlashAmberLoud : (LEDState*)&m_stFlashAmberQuiet;
     } else {
       return &m_stSolid;
     }
@@ -595,33 +996,41 @@ public:
 
 };
 
-class BoostLED : public MultiBlinkingLED {
+class BoostLED final : public MultiBlinkingLED<BoostLED> {
 public:
-  BoostLED(struct CRGB* leds, const struct LEDPosition* ledPosition, int numLEDs, int index) : MultiBlinkingLED(leds, ledPosition, numLEDs, index) {}
-
   // string representation of the state name
-  inline virtual String name() const override { return "Bst"; };
+  inline String name() const { return "Bst"; };
 
-  virtual bool isWarning(const SlaveState &slave) const override {
+  inline bool isWarning(const SlaveState &slave) const {
     return slave.getMasterSignal(MasterSignal::Values::boostWarning);
   }
-  virtual bool isCritical(const SlaveState &slave) const override {
+  inline bool isCritical(const SlaveState &slave) const {
     return slave.getMasterSignal(MasterSignal::Values::boostCritical);
   }
+
+  static inline LEDInputMask inputMask() {
+    return MultiBlinkingLED::inputMask()
+      | ledInputOf(MasterSignal::Values::boostWarning)
+      | ledInputOf(MasterSignal::Values::boostCritical);
+  }
 };
 
-class TachLED : public MultiBlinkingLED {
+class TachLED final : public MultiBlinkingLED<TachLED> {
 public:
-  TachLED(struct CRGB* leds, const struct LEDPosition* ledPosition, int numLEDs, int index) : MultiBlinkingLED(leds, ledPosition, numLEDs, index) {}
-
   // string representation of the state name
-  inline virtual String name() const override { return "Tach"; };
+  inline String name() const { return "Tach"; };
 
-  virtual bool isWarning(const SlaveState &slave) const override {
+  inline bool isWarning(const SlaveState &slave) const {
     return slave.tachometerWarning;
   }
-  virtual bool isCritical(const SlaveState &slave) const override {
+  inline bool isCritical(const SlaveState &slave) const {
     return slave.tachometerCritical;
   }
 
+  static inline LEDInputMask inputMask() {
+    return MultiBlinkingLED::inputMask()
+      | ledInputOf(LEDInput::Values::tachometerWarning)
+      | ledInputOf(LEDInput::Values::tachometerCritical);
+  }
+
 };
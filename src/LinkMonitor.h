@@ -0,0 +1,152 @@
+#pragma once
+
+#include <Arduino.h>
+#include "DashMessage.h"
+
+// how long the slave waits without hearing from the master before it gives up on it, in ms.
+// the master sends a heartbeat every WIRE_PROTOCOL_HEARTBEAT_MS, so this is a few missed ones
+const unsigned int LINK_STALE_TIMEOUT_MS = 500;
+
+// how sequence numbers wrap: they're 7 bits, so they fit in a continuation byte
+const uint8_t LINK_SEQUENCE_MASK = 0x7F;
+
+// The health of the I2C link, as seen by the slave.
+//
+// A quiet master and a dead one look the same from the messages alone -- the signals just
+// stop changing.  So the I2C receiver reports every frame it decodes (and the sequence
+// number that follows it, if the master sends them), and this keeps track of:
+//
+//   - the frames per second, counted over whole seconds
+//   - the gap between frames: the last one and the longest one
+//   - the jitter: how much the gap varies from frame to frame, as a running average
+//     in the style of RFC 3550 (each new difference moves it 1/16th of the way)
+//   - frames lost (skipped sequence numbers) and out of order (sequence numbers that
+//     went backwards, including repeats)
+//   - whether the link is stale: nothing heard for longer than the timeout.  A timeout
+//     of 0 means the link is never stale
+//
+// The receiver side runs in the interrupt handler, so it only does a few additions and
+// comparisons.  The main loop takes its copy of what the receiver wrote with interrupts
+// held off, since a 4-byte number can't be read in one go on an 8-bit AVR.
+typedef struct LinkMonitor {
+  unsigned int staleTimeoutMs;           // how long without a frame before the link is stale; 0 for never
+
+  // INTERRUPT side
+  volatile unsigned long frames;         // frames received
+  volatile unsigned long lastArrival;    // when the last frame arrived
+  volatile unsigned long lastGap;        // the time between the last two frames
+  volatile unsigned long longestGap;     // the longest time between two frames
+  volatile unsigned long jitter16;       // the running jitter, in 16ths of a ms
+  volatile unsigned long lost;           // frames missing from the sequence
+  volatile unsigned long outOfOrder;     // sequence numbers that didn't move forward
+  volatile uint8_t lastSequence;         // the last sequence number seen
+  volatile bool hasArrival;              // whether any frame has arrived
+  volatile bool hasSequence;             // whether any sequence number has arrived
+
+  // LOOP side
+  unsigned long startTime;               // when the monitoring began
+  unsigned long windowStart;             // the start of the second being counted
+  unsigned long windowFrames;            // the frame count at the start of that second
+  unsigned long framesPerSecond;         // frames in the last whole second
+  unsigned long staleCount;              // how many times the link went stale
+  bool started;                          // whether update() has been called since reset()
+  bool stale;                            // whether the link was stale at the last update()
+
+  LinkMonitor(unsigned int timeoutMs = 0) : staleTimeoutMs(timeoutMs) { reset(); }
+
+  // forget everything but the timeout.  not safe to call while the receiver may be running
+  void reset() {
+    frames = 0;
+    lastArrival = 0;
+    lastGap = 0;
+    longestGap = 0;
+    jitter16 = 0;
+    lost = 0;
+    outOfOrder = 0;
+    lastSequence = 0;
+    hasArrival = false;
+    hasSequence = false;
+    startTime = 0;
+    windowStart = 0;
+    windowFrames = 0;
+    framesPerSecond = 0;
+    staleCount = 0;
+    started = false;
+    stale = false;
+  }
+
+  // INTERRUPT: a frame arrived
+  void frameArrived(unsigned long const &millis) {
+    if (hasArrival) {
+      const unsigned long gap = millis - lastArrival;
+      if (gap > longestGap) longestGap = gap;
+      if (frames > 1) {
+        const unsigned long d = gap > lastGap ? gap - lastGap : lastGap - gap;
+        jitter16 = jitter16 + d - (jitter16 >> 4);
+      }
+      lastGap = gap;
+    }
+    lastArrival = millis;
+    hasArrival = true;
+    ++frames;
+  }
+
+  // INTERRUPT: the sequence number of the frame that just arrived
+  void sequenceArrived(uint8_t sequence) {
+    sequence &= LINK_SEQUENCE_MASK;
+    if (hasSequence) {
+      const uint8_t ahead = (sequence - lastSequence) & LINK_SEQUENCE_MASK;
+      if (ahead == 0 || ahead > (LINK_SEQUENCE_MASK >> 1)) {
+        ++outOfOrder; // a repeat, or a late one; don't move backwards
+        return;
+      }
+      lost += ahead - 1;
+    }
+    lastSequence = sequence;
+    hasSequence = true;
+  }
+
+  // LOOP: catch up with the receiver.  returns whether the link is stale
+  bool update(unsigned long const &millis) {
+    noInterrupts();
+    const unsigned long nFrames = frames;
+    const unsigned long arrival = lastArrival;
+    const bool arrived = hasArrival;
+    interrupts();
+
+    if (!started) {
+      started = true;
+      startTime = millis;
+      windowStart = millis;
+      windowFrames = nFrames;
+    }
+
+    if ((long)(millis - windowStart) >= 1000) {
+      framesPerSecond = nFrames - windowFrames;
+      windowFrames = nFrames;
+      windowStart = millis;
+    }
+
+    const unsigned long since = millis - (arrived ? arrival : startTime);
+    const bool nowStale = staleTimeoutMs && (long)since > (long)staleTimeoutMs;
+    if (nowStale && !stale) ++staleCount;
+    stale = nowStale;
+    return stale;
+  }
+
+  // LOOP: summary of the link health
+  String toString() const {
+    noInterrupts();
+    const unsigned long gap = longestGap;
+    const unsigned long nLost = lost;
+    const unsigned long nOutOfOrder = outOfOrder;
+    const unsigned long jitter = jitter16 >> 4;
+    interrupts();
+
+    char ret[sizeof("lnk /s gap  jit  lost  ooo  STALE") + 5 * ULONG_TEXT_DIGITS];
+    snprintf(ret, sizeof(ret), "lnk %lu/s gap %lu jit %lu lost %lu ooo %lu%s",
+      framesPerSecond, gap, jitter, nLost, nOutOfOrder, stale ? " STALE" : "");
+    return String(ret);
+  }
+
+} LinkMonitor;
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <Arduino.h>
+#include "MasterProperties.h"
+#include "DashMessage.h"
+
+// The signals of the master, one bit each, by MasterSignal position
+typedef uint16_t MasterSignalMask;
+static_assert(MASTERSIGNAL_MAX < 16, "The master signals must fit in a MasterSignalMask");
+
+// the mask for a single master signal
+inline MasterSignalMask masterSignalOf(MasterSignal::Values v) { return (MasterSignalMask)1 << v; }
+
+// The edges latched by a MasterInputs capture, as taken by the main loop
+typedef struct MasterEdges {
+  MasterSignalMask level; // each signal's level as of the last capture
+  MasterSignalMask rose;  // signals that went high since the last take
+  MasterSignalMask fell;  // signals that went low since the last take
+} MasterEdges;
+
+// Interrupt-driven capture of the master's input pins.
+//
+// The main loop only gets around to reading the pins every so often, and a quick press
+// of a button can come and go in between.  So a pin-change interrupt calls capture(),
+// which reads all of the pins and latches any edges into bitmasks, along with the time
+// of each signal's last rise.  The main loop takes the latched edges when it's ready, and
+// builds its message from them -- so no press is ever lost, even if it was released
+// again before the loop noticed.
+//
+// The pins are read through a function pointer (as with DashMessage::setFromPins), so
+// this can be driven from the GODMODE pin mocks in the unit tests.
+typedef struct MasterInputs {
+  volatile MasterSignalMask level;              // each signal's level as of the last capture
+  volatile MasterSignalMask rose;               // signals that went high since the last take
+  volatile MasterSignalMask fell;               // signals that went low since the last take
+  volatile unsigned long riseTime[MASTERSIGNAL_MAX + 1]; // when each signal last went high
+  volatile unsigned long captures;              // how many captures saw a change
+
+  // the main loop's side of things
+  MasterSignalMask holding;                     // signals being held high for the minimum pulse
+  unsigned long holdStart[MASTERSIGNAL_MAX + 1]; // when each held signal went high
+
+  MasterInputs() { reset(); }
+
+  // forget everything.  not safe to call while the interrupt may fire
+  void reset() {
+    level = 0;
+    rose = 0;
+    fell = 0;
+    captures = 0;
+    holding = 0;
+    for (unsigned int i = 0; i <= MASTERSIGNAL_MAX; ++i) {
+      riseTime[i] = 0;
+      holdStart[i] = 0;
+    }
+  }
+
+  // read every master pin into a mask
+  template<typename DigitalRead, typename = IfPinReader<DigitalRead>>
+  static MasterSignalMask readPins(DigitalRead myDigitalRead) {
+    MasterSignalMask ret = 0;
+    if (myDigitalRead(MasterPin::Values::boostWarning        )) ret |= masterSignalOf(MasterSignal::Values::boostWarning);
+    if (myDigitalRead(MasterPin::Values::boostCritical       )) ret |= masterSignalOf(MasterSignal::Values::boostCritical);
+    if (myDigitalRead(MasterPin::Values::acOn                )) ret |= masterSignalOf(MasterSignal::Values::acOn);
+    if (myDigitalRead(MasterPin::Values::heatedRearWindowOn  )) ret |= masterSignalOf(MasterSignal::Values::heatedRearWindowOn);
+    if (myDigitalRead(MasterPin::Values::hazardOff           )) ret |= masterSignalOf(MasterSignal::Values::hazardOff);
+    if (myDigitalRead(MasterPin::Values::rearFoggerOn        )) ret |= masterSignalOf(MasterSignal::Values::rearFoggerOn);
+    if (myDigitalRead(MasterPin::Values::scrollCAN           )) ret |= masterSignalOf(MasterSignal::Values::scrollCAN);
+    if (myDigitalRead(MasterPin::Values::scrollPresetColours )) ret |= masterSignalOf(MasterSignal::Values::scrollPresetColours);
+    if (myDigitalRead(MasterPin::Values::scrollRainbowEffects)) ret |= masterSignalOf(MasterSignal::Values::scrollRainbowEffects);
+    if (myDigitalRead(MasterPin::Values::scrollBrightness    )) ret |= masterSignalOf(MasterSignal::Values::scrollBrightness);
+    return ret;
+  }
+
+  // read every master pin from a snapshot of the ports
+  static MasterSignalMask readPins(PortSnapshot const &ports) {
+    MasterSignalMask ret = 0;
+    if (ports.isHigh(MasterPin::Values::boostWarning        )) ret |= masterSignalOf(MasterSignal::Values::boostWarning);
+    if (ports.isHigh(MasterPin::Values::boostCritical       )) ret |= masterSignalOf(MasterSignal::Values::boostCritical);
+    if (ports.isHigh(MasterPin::Values::acOn                )) ret |= masterSignalOf(MasterSignal::Values::acOn);
+    if (ports.isHigh(MasterPin::Values::heatedRearWindowOn  )) ret |= masterSignalOf(MasterSignal::Values::heatedRearWindowOn);
+    if (ports.isHigh(MasterPin::Values::hazardOff           )) ret |= masterSignalOf(MasterSignal::Values::hazardOff);
+    if (ports.isHigh(MasterPin::Values::rearFoggerOn        )) ret |= masterSignalOf(MasterSignal::Values::rearFoggerOn);
+    if (ports.isHigh(MasterPin::Values::scrollCAN           )) ret |= masterSignalOf(MasterSignal::Values::scrollCAN);
+    if (ports.isHigh(MasterPin::Values::scrollPresetColours )) ret |= masterSignalOf(MasterSignal::Values::scrollPresetColours);
+    if (ports.isHigh(MasterPin::Values::scrollRainbowEffects)) ret |= masterSignalOf(MasterSignal::Values::scrollRainbowEffects);
+    if (ports.isHigh(MasterPin::Values::scrollBrightness    )) ret |= masterSignalOf(MasterSignal::Values::scrollBrightness);
+    return ret;
+  }
+
+  // INTERRUPT: latch whatever changed since the last capture
+  void capture(MasterSignalMask now, unsigned long const &millis) {
+    const MasterSignalMask changed = now ^ level;
+    if (!changed) return;
+
+    const MasterSignalMask up = changed & now;
+    rose |= up;
+    fell |= changed & (MasterSignalMask)~now;
+    for (unsigned int i = 0; i <= MASTERSIGNAL_MAX; ++i) {
+      if (up & ((MasterSignalMask)1 << i)) riseTime[i] = millis;
+    }
+    level = now;
+    ++captures;
+  }
+
+  // INTERRUPT: read the pins and latch whatever changed
+  template<typename DigitalRead, typename = IfPinReader<DigitalRead>>
+  inline void capture(DigitalRead myDigitalRead, unsigned long const &millis) {
+    capture(readPins(myDigitalRead), millis);
+  }
+
+  // INTERRUPT: latch whatever changed in a snapshot of the ports
+  inline void capture(PortSnapshot const &ports, unsigned long const &millis) {
+    capture(readPins(ports), millis);
+  }
+
+  // LOOP: take the latched edges, leaving none.  the interrupt is held off while they're copied
+  MasterEdges take() {
+    MasterEdges ret;
+    noInterrupts();
+    ret.level = level;
+    ret.rose = rose;
+    ret.fell = fell;
+    rose = 0;
+    fell = 0;
+    for (unsigned int i = 0; i <= MASTERSIGNAL_MAX; ++i) {
+      if (ret.rose & ((MasterSignalMask)1 << i)) holdStart[i] = riseTime[i];
+    }
+    interrupts();
+    return ret;
+  }
+
+  // LOOP: the signals to send.  that's the current levels, except that every signal that went
+  // high stays high for at least WIRE_PROTOCOL_MIN_PULSE_MS -- even if it has gone low again already.
+  // a new rise is always reported at least once, however late the loop is to see it
+  MasterSignalMask signals(unsigned long const &millis) {
+    if (holding) {
+      for (unsigned int i = 0; i <= MASTERSIGNAL_MAX; ++i) {
+        const MasterSignalMask bit = (MasterSignalMask)1 << i;
+        if ((holding & bit) && (long)(millis - holdStart[i]) >= (long)WIRE_PROTOCOL_MIN_PULSE_MS) holding &= (MasterSignalMask)~bit;
+      }
+    }
+    const MasterEdges e = take();
+    holding |= e.rose;
+    return e.level | holding;
+  }
+
+  // LOOP: the message to send
+  DashMessage message(unsigned long const &millis) {
+    const MasterSignalMask s = signals(millis);
+    DashMessage ret;
+    for (unsigned int i = 0; i <= MASTERSIGNAL_MAX; ++i) {
+      ret.setBit((MasterSignal::Values)i, s & ((MasterSignalMask)1 << i));
+    }
+    return ret;
+  }
+
+} MasterInputs;
@@ -1,4 +1,5 @@
 #pragma once
+#include <Arduino.h>
 
 /**
  * This file defines some of the properties of the master board
@@ -20,7 +21,8 @@ namespace MasterPin {
     scrollCAN            = 9,
     scrollPresetColours  = 10,
     scrollRainbowEffects = 11,
-    scrollBrightness     = 12
+    scrollBrightness     = 12,
+    boostPressure        = A0  // analog in boost pressure sensor
   };
 }
 
@@ -43,3 +45,49 @@ namespace MasterSignal {
 // min and max for the enum, for iterating
 const unsigned int MASTERSIGNAL_MIN = MasterSignal::Values::boostWarning;
 const unsigned int MASTERSIGNAL_MAX = MasterSignal::Values::scrollBrightness;
+
+// how far, in analogRead() counts, a reading has to stray outside the range of a field's
+// last value before the field takes a new one.  without it, a reading that sits on the edge
+// between two values flickers between them, and every flicker is a frame on the wire
+const int MASTER_FIELD_DEADBAND = 8;
+
+// A reading communicated by the master: an unsigned number of some fixed width, packed into
+// the message's payload bits starting at some position.  Everything about a field is a
+// compile-time constant, so the packing of each one is worked out by the compiler.
+template <unsigned int Position, unsigned int Width>
+struct MasterFieldOf {
+  static_assert(Width >= 1 && Width <= 16, "A field is between 1 and 16 bits wide");
+  static const unsigned int position = Position;         // the first payload bit
+  static const unsigned int width    = Width;            // how many payload bits
+  static const unsigned int end      = Position + Width; // where the next field can start
+  static const uint16_t maxValue     = (uint16_t)((1ul << Width) - 1);
+
+  // quantize a 10-bit analogRead() value to this width, keeping the top bits
+  static constexpr uint16_t fromAnalog(int reading) {
+    return Width >= 10 ? (uint16_t)reading << (Width - 10) : (uint16_t)reading >> (10 - Width);
+  }
+
+  // quantize a reading as above, but with hysteresis: keep the last value while the reading
+  // is within the deadband of the readings that give it
+  static uint16_t fromAnalog(int reading, uint16_t last, int deadband = MASTER_FIELD_DEADBAND) {
+    const uint16_t value = fromAnalog(reading);
+    if (value == last) return value;
+    const int lowest  = Width >= 10 ? last >> (Width - 10) : (int)last << (10 - Width);
+    const int highest = Width >= 10 ? lowest : lowest + (1 << (10 - Width)) - 1;
+    return (reading < lowest - deadband || highest + deadband < reading) ? value : last;
+  }
+
+  // spread a field value back over the 10-bit analogRead() scale
+  static constexpr int toAnalog(uint16_t value) {
+    return Width >= 10 ? value >> (Width - 10) : (int)(((unsigned long)value * 1023) / maxValue);
+  }
+};
+
+// readings communicated by the master, packed after the signals.  each one starts where
+// the last one ends
+namespace MasterField {
+  typedef MasterFieldOf<MASTERSIGNAL_MAX + 1, 4> boostPressure; // the boost sensor, in 16ths of its range
+}
+
+// how many payload bits the master sends: the signals, then the fields
+const unsigned int MASTER_PAYLOAD_BITS = MasterField::boostPressure::end;
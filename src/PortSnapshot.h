@@ -0,0 +1,127 @@
+#pragma once
+
+#include <Arduino.h>
+
+#ifndef pin_size_t
+  using pin_size_t = uint8_t;
+#endif
+
+/*
+
+Reading pins a whole port at a time
+
+Every call to digitalRead() looks the pin up in three tables (port, bit mask, timer),
+turns off any PWM on it, and then reads the port -- dozens of cycles for one bit.  Our
+boards read ten or so pins at a time, and those pins live on two or three ports.  So a
+PortSnapshot reads each input port register once, and the pins are then picked out of
+the copy with masks that the compiler works out ahead of time.
+
+Which pin is on which port depends on the board, so the layout is chosen at compile time:
+
+  - ATmega328P (uno, nano): D0-D7 on PORTD, D8-D13 on PORTB, A0-A5 on PORTC
+  - ATmega4809 (nano_every): scattered across VPORTA-VPORTF, per the board's variant
+  - anything else, including the unit tests: a pretend "port" for every 8 pins, filled
+    in with digitalRead() -- so GODMODE pin mocks still work, just not quickly
+
+None of this sets up the pins; pinMode() is still needed for that.
+*/
+
+#if !defined(ARDUINO_CI_COMPILATION_MOCKS) && defined(__AVR_ATmega328P__)
+
+  #define PORT_SNAPSHOT_REGISTERS
+  namespace GPIOPort {
+    enum Values : uint8_t { b = 0, c = 1, d = 2 };
+  }
+  const uint8_t GPIO_PORT_COUNT = 3;
+  const pin_size_t GPIO_PIN_COUNT = 20;
+
+  // the port and bit for each pin
+  constexpr uint8_t gpioPortOf(pin_size_t pin) {
+    return pin < 8 ? GPIOPort::Values::d : pin < 14 ? GPIOPort::Values::b : GPIOPort::Values::c;
+  }
+  constexpr uint8_t gpioMaskOf(pin_size_t pin) {
+    return 1 << (pin < 8 ? pin : pin < 14 ? pin - 8 : pin - 14);
+  }
+
+#elif !defined(ARDUINO_CI_COMPILATION_MOCKS) && defined(__AVR_ATmega4809__)
+
+  #define PORT_SNAPSHOT_REGISTERS
+  namespace GPIOPort {
+    enum Values : uint8_t { a = 0, b = 1, c = 2, d = 3, e = 4, f = 5 };
+  }
+  const uint8_t GPIO_PORT_COUNT = 6;
+  const pin_size_t GPIO_PIN_COUNT = 22;
+
+  // the port (high nybble) and bit (low nybble) of each pin of the nano every
+  constexpr uint8_t gpioPinCode(pin_size_t pin) {
+    return pin ==  0 ? 0x25 : pin ==  1 ? 0x24 : pin ==  2 ? 0x00 : pin ==  3 ? 0x55 :
+           pin ==  4 ? 0x26 : pin ==  5 ? 0x12 : pin ==  6 ? 0x54 : pin ==  7 ? 0x01 :
+           pin ==  8 ? 0x43 : pin ==  9 ? 0x10 : pin == 10 ? 0x11 : pin == 11 ? 0x40 :
+           pin == 12 ? 0x41 : pin == 13 ? 0x42 : pin == 14 ? 0x33 : pin == 15 ? 0x32 :
+           pin == 16 ? 0x31 : pin == 17 ? 0x30 : pin == 18 ? 0x52 : pin == 19 ? 0x53 :
+           pin == 20 ? 0x34 : 0x35;
+  }
+  constexpr uint8_t gpioPortOf(pin_size_t pin) { return gpioPinCode(pin) >> 4; }
+  constexpr uint8_t gpioMaskOf(pin_size_t pin) { return 1 << (gpioPinCode(pin) & 0x0F); }
+
+#else
+
+  // no registers we know of: every 8 pins make a port
+  const uint8_t GPIO_PORT_COUNT = 3;
+  const pin_size_t GPIO_PIN_COUNT = 8 * GPIO_PORT_COUNT;
+
+  constexpr uint8_t gpioPortOf(pin_size_t pin) { return pin / 8; }
+  constexpr uint8_t gpioMaskOf(pin_size_t pin) { return 1 << (pin % 8); }
+
+#endif
+
+// whether a pin can be read from a snapshot at all
+constexpr bool gpioHasPin(pin_size_t pin) {
+  return pin < GPIO_PIN_COUNT;
+}
+
+// for templates that read pins with "anything that can be called like digitalRead": a
+// function of whichever signature the board uses, or a function object from a support policy.
+// this keeps those templates out of the way of overloads taking anything else
+template<typename DigitalRead>
+using IfPinReader = decltype((*(DigitalRead*)0)((pin_size_t)0), void());
+
+// The input ports, as they were at one moment
+typedef struct PortSnapshot {
+  uint8_t port[GPIO_PORT_COUNT];
+
+  // whether a pin was high.  with a constant pin, this is a single AND
+  inline bool isHigh(pin_size_t pin) const {
+    return port[gpioPortOf(pin)] & gpioMaskOf(pin);
+  }
+
+  // fill in the snapshot one pin at a time, from the given function
+  template<typename DigitalRead>
+  void setFromPins(DigitalRead myDigitalRead) {
+    for (uint8_t i = 0; i < GPIO_PORT_COUNT; ++i) port[i] = 0;
+    for (pin_size_t p = 0; p < GPIO_PIN_COUNT; ++p) {
+      if (myDigitalRead(p)) port[gpioPortOf(p)] |= gpioMaskOf(p);
+    }
+  }
+
+  // read the ports as they are now
+  static PortSnapshot sample() {
+    PortSnapshot ret;
+#if !defined(PORT_SNAPSHOT_REGISTERS)
+    ret.setFromPins(digitalRead);
+#elif defined(__AVR_ATmega328P__)
+    ret.port[GPIOPort::Values::b] = PINB;
+    ret.port[GPIOPort::Values::c] = PINC;
+    ret.port[GPIOPort::Values::d] = PIND;
+#else
+    ret.port[GPIOPort::Values::a] = VPORTA.IN;
+    ret.port[GPIOPort::Values::b] = VPORTB.IN;
+    ret.port[GPIOPort::Values::c] = VPORTC.IN;
+    ret.port[GPIOPort::Values::d] = VPORTD.IN;
+    ret.port[GPIOPort::Values::e] = VPORTE.IN;
+    ret.port[GPIOPort::Values::f] = VPORTF.IN;
+#endif
+    return ret;
+  }
+
+} PortSnapshot;
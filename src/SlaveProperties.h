@@ -4,11 +4,12 @@
 #include "Debouncer.h"
 
 unsigned int const DEBOUNCE_TIME_MS = 50;
+static_assert(DEBOUNCE_TIME_MS < WIRE_PROTOCOL_MIN_PULSE_MS, "The slave would debounce away the master's shortest pulse");
 unsigned int const SCROLLCAN_PULSE_TIME = 50; // The duration of the HIGH signal to output when scrolling CAN
 
 // we may define a bunch of rainbow modes, and here is how we keep track of them
 typedef struct EffectMode {
-  enum Values {
+  enum Values : uint8_t {
     none    = 0,
     rainbow = 1,
     sparkle = 2,
@@ -30,6 +31,60 @@ typedef struct EffectMode {
  *
  */
 
+// The inputs that LEDs can respond to, as bit positions in an LEDInputMask.
+//
+// The master signals occupy the bit positions of their MasterSignal values,
+// and the slave's own inputs come after them.  An LED declares which of these
+// it reads, and it only gets reevaluated when one of those bits changes.
+namespace LEDInput {
+  enum Values {
+    tachometerWarning  = MASTERSIGNAL_MAX + 1,
+    tachometerCritical = MASTERSIGNAL_MAX + 2,
+    effectMode         = MASTERSIGNAL_MAX + 3
+  };
+}
+
+typedef uint32_t LEDInputMask;
+static_assert(LEDInput::Values::effectMode < 32, "The LED inputs must fit in an LEDInputMask");
+
+const LEDInputMask LED_INPUT_NONE = 0;
+const LEDInputMask LED_INPUT_MASTER_SIGNALS = ((LEDInputMask)1 << (MASTERSIGNAL_MAX + 1)) - 1;
+
+// the mask for a single master signal
+inline LEDInputMask ledInputOf(MasterSignal::Values v) { return (LEDInputMask)1 << v; }
+
+// the mask for a single slave input
+inline LEDInputMask ledInputOf(LEDInput::Values v) { return (LEDInputMask)1 << v; }
+
+// The digital signals that the slave debounces, as bit positions in a SlaveSignalMask.
+//
+// As in an LEDInputMask, the master signals occupy the bit positions of their MasterSignal
+// values, and the slave's own digital pins come after them.
+namespace SlaveSignal {
+  enum Values {
+    ignition           = MASTERSIGNAL_MAX + 1,
+    backlightDim       = MASTERSIGNAL_MAX + 2,
+    tachometerWarning  = MASTERSIGNAL_MAX + 3,
+    tachometerCritical = MASTERSIGNAL_MAX + 4
+  };
+}
+
+typedef uint16_t SlaveSignalMask;
+static_assert(SlaveSignal::Values::tachometerCritical < 16, "The slave signals must fit in a SlaveSignalMask");
+
+// the mask for a single master signal
+inline SlaveSignalMask signalOf(MasterSignal::Values v) { return (SlaveSignalMask)1 << v; }
+
+// the mask for a single slave pin
+inline SlaveSignalMask signalOf(SlaveSignal::Values v) { return (SlaveSignalMask)1 << v; }
+
+// the master's buttons, which need debouncing
+const SlaveSignalMask SLAVE_SIGNAL_BUTTONS =
+  signalOf(MasterSignal::Values::scrollCAN)
+  | signalOf(MasterSignal::Values::scrollPresetColours)
+  | signalOf(MasterSignal::Values::scrollRainbowEffects)
+  | signalOf(MasterSignal::Values::scrollBrightness);
+
 // digital pin assignments for the slave
 namespace SlavePin {
   enum Values {
@@ -51,26 +106,24 @@ namespace SlavePin {
   };
 }
 
-// This struct is responsible for all of the reading and bookkeeping of
-// the information that the slave board can collect
+// One sample of everything the slave board knows about its inputs: what the pins read
+// and what the master last said.  This is what the LEDs and gauges are driven from.
+//
+// It's deliberately small and plain (bools as bits, sensor readings in 16 bits, and no
+// constructors beyond the default), so that copying one is a short block move and
+// everything in it survives the copy.  Anything that has to persist across samples --
+// debouncers and the like -- lives in SlaveEvents instead.
 typedef struct SlaveState {
-  bool backlightDim;
-  bool tachometerCritical;
-  bool tachometerWarning;
-  bool ignition;
-
-  int fuelLevel;
-  int temperatureLevel;
-  int oilPressureLevel;
+  int16_t fuelLevel;
+  int16_t temperatureLevel;
+  int16_t oilPressureLevel;
 
   DashMessage masterMessage;
 
-  Debouncer CANEvent;
-  Debouncer colorEvent;
-  Debouncer effectsEvent;     //TODO: mark private
-  Debouncer brightnessEvent;
-
-  unsigned long CANPulseBegin; // the time at which a CAN pulse should start
+  bool backlightDim       : 1;
+  bool tachometerCritical : 1;
+  bool tachometerWarning  : 1;
+  bool ignition           : 1;
 
   EffectMode effectmode;
 
@@ -92,7 +145,8 @@ typedef struct SlaveState {
 
   // Best if we keep the necessary setup for all the pins in this class,
   // since it needs to agree with the code that reads from those pins
-  static void setup(void (*myPinMode)(uint8_t, uint8_t)) {
+  template<typename PinMode>
+  static void setup(PinMode myPinMode) {
     myPinMode(SlavePin::Values::backlightDim,       INPUT);
     myPinMode(SlavePin::Values::tachometerCritical, INPUT);
     myPinMode(SlavePin::Values::tachometerWarning,  INPUT);
@@ -102,23 +156,9 @@ typedef struct SlaveState {
     myPinMode(SlavePin::Values::ignitionInput,      INPUT);
   }
 
-
-#ifdef pin_size_t
-  // Best if we keep the necessary setup for all the pins in this class,
-  // since it needs to agree with the code that reads from those pins
-  static void setup(void (*myPinMode)(pin_size_t, int)) {
-    myPinMode(SlavePin::Values::backlightDim,       INPUT);
-    myPinMode(SlavePin::Values::tachometerCritical, INPUT);
-    myPinMode(SlavePin::Values::tachometerWarning,  INPUT);
-    myPinMode(SlavePin::Values::fuelInput,          INPUT);
-    myPinMode(SlavePin::Values::temperatureInput,   INPUT);
-    myPinMode(SlavePin::Values::oilInput,           INPUT);
-    myPinMode(SlavePin::Values::ignitionInput,      INPUT);
-  }
-#endif
-
   // read payload from digital input pins into the fields of this struct
-  void setFromPins(int (*myDigitalRead)(pin_size_t), int (*myAnalogRead)(pin_size_t)) {
+  template<typename DigitalRead, typename AnalogRead>
+  void setFromPins(DigitalRead myDigitalRead, AnalogRead myAnalogRead) {
     backlightDim       = myDigitalRead(SlavePin::Values::backlightDim);
     tachometerCritical = myDigitalRead(SlavePin::Values::tachometerCritical);
     tachometerWarning  = myDigitalRead(SlavePin::Values::tachometerWarning);
@@ -129,40 +169,78 @@ typedef struct SlaveState {
     oilPressureLevel = myAnalogRead(SlavePin::Values::oilInput);
   }
 
-#ifdef PinStatus
-  // read payload from digital input pins into the fields of this struct
-  void setFromPins(PinStatus (*myDigitalRead)(pin_size_t), int (*myAnalogRead)(pin_size_t)) {
-    backlightDim       = myDigitalRead(SlavePin::Values::backlightDim);
-    tachometerCritical = myDigitalRead(SlavePin::Values::tachometerCritical);
-    tachometerWarning  = myDigitalRead(SlavePin::Values::tachometerWarning);
-    ignition           = myDigitalRead(SlavePin::Values::ignitionInput);
+  // read payload from a snapshot of the input ports, and the analog pins
+  static_assert(gpioHasPin(SlavePin::Values::ignitionInput) && gpioHasPin(SlavePin::Values::backlightDim) &&
+                gpioHasPin(SlavePin::Values::tachometerCritical) && gpioHasPin(SlavePin::Values::tachometerWarning),
+                "A slave input pin isn't on a port we snapshot");
+  template<typename AnalogRead>
+  void setFromPorts(PortSnapshot const &ports, AnalogRead myAnalogRead) {
+    backlightDim       = ports.isHigh(SlavePin::Values::backlightDim);
+    tachometerCritical = ports.isHigh(SlavePin::Values::tachometerCritical);
+    tachometerWarning  = ports.isHigh(SlavePin::Values::tachometerWarning);
+    ignition           = ports.isHigh(SlavePin::Values::ignitionInput);
 
     fuelLevel        = myAnalogRead(SlavePin::Values::fuelInput);
     temperatureLevel = myAnalogRead(SlavePin::Values::temperatureInput);
     oilPressureLevel = myAnalogRead(SlavePin::Values::oilInput);
   }
-#endif
 
-  void debounce(unsigned long const &millis) {
-    // TODO: convert these into eventOf things
-    CANEvent.process(millis, masterMessage.getBit(MasterSignal::Values::scrollCAN));
-    colorEvent.process(millis, masterMessage.getBit(MasterSignal::Values::scrollPresetColours));
-    brightnessEvent.process(millis, masterMessage.getBit(MasterSignal::Values::scrollBrightness));
+  // take the inputs from another sample, e.g. a recorded one, leaving the rest as it is
+  void setInputs(SlaveState const &s) {
+    backlightDim       = s.backlightDim;
+    tachometerCritical = s.tachometerCritical;
+    tachometerWarning  = s.tachometerWarning;
+    ignition           = s.ignition;
 
-    if (Debouncer::Event::toHigh == CANEvent.eventOf(millis, masterMessage.getBit(MasterSignal::Values::scrollCAN))) {
-      CANPulseBegin = millis;
+    fuelLevel        = s.fuelLevel;
+    temperatureLevel = s.temperatureLevel;
+    oilPressureLevel = s.oilPressureLevel;
+  }
+
+  // which of the things that the LEDs respond to differ between this state and another.
+  // the payload bits of the message line up with the MasterSignal positions, 7 per byte.
+  // the fields after the signals are left out
+  LEDInputMask changedLEDInputs(SlaveState const &s) const {
+    LEDInputMask ret = LED_INPUT_NONE;
+    for (unsigned int i = 0; i < WIRE_PROTOCOL_SIGNAL_BYTES; ++i) {
+      const byte diff = (masterMessage.rawData[i] ^ s.masterMessage.rawData[i]) & ~FIRST_FRAME_MARKER_MASK;
+      ret |= (LEDInputMask)diff << (7 * i);
     }
+    ret &= LED_INPUT_MASTER_SIGNALS;
+
+    if (tachometerWarning  != s.tachometerWarning)  ret |= ledInputOf(LEDInput::Values::tachometerWarning);
+    if (tachometerCritical != s.tachometerCritical) ret |= ledInputOf(LEDInput::Values::tachometerCritical);
+    if (effectmode.state   != s.effectmode.state)   ret |= ledInputOf(LEDInput::Values::effectMode);
+    return ret;
+  }
 
-    if (Debouncer::Event::toHigh == effectsEvent.eventOf(millis, masterMessage.getBit(MasterSignal::Values::scrollRainbowEffects))) {
-      effectmode.next();
+  // every digital signal in this sample, one bit each
+  SlaveSignalMask signals() const {
+    SlaveSignalMask ret = 0;
+    for (unsigned int i = 0; i < WIRE_PROTOCOL_SIGNAL_BYTES; ++i) {
+      ret |= (SlaveSignalMask)(masterMessage.rawData[i] & ~FIRST_FRAME_MARKER_MASK) << (7 * i);
     }
+    ret &= signalOf(SlaveSignal::Values::ignition) - 1; // just the master signals
+
+    if (ignition)           ret |= signalOf(SlaveSignal::Values::ignition);
+    if (backlightDim)       ret |= signalOf(SlaveSignal::Values::backlightDim);
+    if (tachometerWarning)  ret |= signalOf(SlaveSignal::Values::tachometerWarning);
+    if (tachometerCritical) ret |= signalOf(SlaveSignal::Values::tachometerCritical);
+    return ret;
   }
 
-  // whether the signal to scroll CAN should be high
-  bool scrollCANstate(unsigned long const &millis) {
-    return SCROLLCAN_PULSE_TIME < millis // don't pulse when the car is first turned on
-      && CANPulseBegin <= millis         // do pulse if we should start pulsing
-      && millis < (CANPulseBegin + SCROLLCAN_PULSE_TIME); // stop pulse after it expires
+  // set every digital signal in this sample from a mask like signals() gives.  the message's
+  // fields and framing are left alone
+  void setSignals(SlaveSignalMask s) {
+    for (unsigned int i = 0; i < WIRE_PROTOCOL_SIGNAL_BYTES; ++i) {
+      const byte m = (byte)((signalOf(SlaveSignal::Values::ignition) - 1) >> (7 * i)) & ~FIRST_FRAME_MARKER_MASK;
+      masterMessage.setRawByte(i, (masterMessage.rawData[i] & ~m) | ((byte)(s >> (7 * i)) & m));
+    }
+
+    ignition           = s & signalOf(SlaveSignal::Values::ignition);
+    backlightDim       = s & signalOf(SlaveSignal::Values::backlightDim);
+    tachometerWarning  = s & signalOf(SlaveSignal::Values::tachometerWarning);
+    tachometerCritical = s & signalOf(SlaveSignal::Values::tachometerCritical);
   }
 
   // make a binary representation of what's in the message
@@ -172,14 +250,6 @@ typedef struct SlaveState {
     ret.concat(backlightDim       ? "b" : "B");
     ret.concat(tachometerCritical ? "C" : (tachometerWarning ? "W" : "_"));
 
-    ret.concat(" ");
-    if (effectsEvent.last == Debouncer::Event::none) {
-      ret.concat("_");
-    } else if (effectsEvent.last == Debouncer::Event::toLow) {
-      ret.concat("v");
-    } else if (effectsEvent.last == Debouncer::Event::toHigh) {
-      ret.concat("/");
-    }
     ret.concat(" ");
     if (effectmode.state == EffectMode::Values::none) {
       ret.concat("N");
@@ -197,21 +267,15 @@ typedef struct SlaveState {
     return ret;
   }
 
-  // default constructor: assign the debounce times. this means we need to define all other
-  // constructors and assignment operators
+  // default constructor: nothing on, nothing read
   SlaveState() :
+    fuelLevel(0),
+    temperatureLevel(0),
+    oilPressureLevel(0),
     backlightDim(0),
     tachometerCritical(0),
     tachometerWarning(0),
-    ignition(0),
-    fuelLevel(0),
-    temperatureLevel(0),
-    oilPressureLevel(),
-    CANEvent(DEBOUNCE_TIME_MS),
-    colorEvent(DEBOUNCE_TIME_MS),
-    effectsEvent(DEBOUNCE_TIME_MS),
-    brightnessEvent(DEBOUNCE_TIME_MS),
-    CANPulseBegin(0)
+    ignition(0)
   { }
 
   // shortcut: construct directly from the pin states
@@ -230,25 +294,70 @@ typedef struct SlaveState {
   }
 #endif
 
-  // assignment operator
-  SlaveState& operator=(SlaveState const &s) {
-    backlightDim        = s.backlightDim;
-    tachometerCritical  = s.tachometerCritical;
-    ignition            = s.ignition;
-    fuelLevel           = s.fuelLevel;
-    temperatureLevel    = s.temperatureLevel;
-    oilPressureLevel    = s.oilPressureLevel;
-    masterMessage       = s.masterMessage;
-    CANPulseBegin       = s.CANPulseBegin;
-    effectmode          = s.effectmode;
-    return *this;
-  }
-
-  SlaveState(SlaveState const &s) :
-    SlaveState()
+} SlaveState;
+
+
+// The processing that turns a stream of SlaveState samples into events: the debouncing of
+// every digital signal, and what the master's buttons do.  This persists from one sample to
+// the next, and is never copied.
+//
+// Only the master's buttons get a stable time.  The other signals go through the same bank,
+// with a stable time of 0: the indicators are already settled by the master, the tachometer
+// lights are a shift light (any delay is a late shift), and the ignition and dimmer are
+// expected to take effect on the loop that sees them.  Any of them can be given a stable
+// time with debouncer.setStableTime(), since the dash acts on the debounced levels (see
+// stabilize()) rather than the raw sample.
+typedef struct SlaveEvents {
+  DebouncerBank<SlaveSignalMask> debouncer;
+  unsigned long CANPulseBegin; // the time at which a CAN pulse should start
+
+  static_assert(DEBOUNCE_TIME_MS <= DebouncerBank<SlaveSignalMask>::MAX_STABLE_TIME, "The debouncer can't count that high");
+
+  SlaveEvents() :
+    CANPulseBegin(0)
   {
-    SlaveState::operator=(s);
+    debouncer.setStableTime(SLAVE_SIGNAL_BUTTONS, DEBOUNCE_TIME_MS);
   }
 
+  // forget all history
+  void reset() {
+    debouncer.reset();
+    CANPulseBegin = 0;
+  }
 
-} SlaveState;
+  // process every signal in a new sample.  the effect mode is stepped in the sample itself
+  void debounce(unsigned long const &millis, SlaveState &sample) {
+    debouncer.process(millis, sample.signals());
+
+    if (debouncer.rose & signalOf(MasterSignal::Values::scrollCAN)) {
+      CANPulseBegin = millis;
+    }
+
+    if (debouncer.rose & signalOf(MasterSignal::Values::scrollRainbowEffects)) {
+      sample.effectmode.next();
+    }
+  }
+
+  // replace the digital signals in a sample with their debounced levels.  this goes in a copy:
+  // the raw sample has to be kept for the next process(), since a message isn't resent
+  inline void stabilize(SlaveState &sample) const {
+    sample.setSignals(debouncer.stable);
+  }
+
+  // whether the signal to scroll CAN should be high
+  bool scrollCANstate(unsigned long const &millis) const {
+    return SCROLLCAN_PULSE_TIME < millis // don't pulse when the car is first turned on
+      && CANPulseBegin <= millis         // do pulse if we should start pulsing
+      && millis < (CANPulseBegin + SCROLLCAN_PULSE_TIME); // stop pulse after it expires
+  }
+
+  // the last event on the effects button
+  String toString() const {
+    switch (debouncer.eventOf(signalOf(MasterSignal::Values::scrollRainbowEffects))) {
+    case Debouncer::Event::toLow:  return "v";
+    case Debouncer::Event::toHigh: return "/";
+    default:                       return "_";
+    }
+  }
+
+} SlaveEvents;
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <Arduino.h>
+#include "DashMessage.h"
+
+#ifndef ARDUINO_CI_COMPILATION_MOCKS
+  #include <FastLED.h>
+#else
+  #include "FakeFastLED.h"
+#endif
+
+// The render stage for the LED strip.
+//
+// Pushing a frame to a WS2812B strip (the show() call) blocks interrupts for
+// roughly 1ms on a short strip, and that is time in which we can miss I2C bytes.
+// Most of the time, the dash isn't actually changing -- so this struct keeps a
+// copy of the last frame that was pushed to the strip (pixels and brightness)
+// and only pushes a new one when something is different.  It also caps the
+// refresh rate, so that a rapidly-changing animation can't hog the CPU.
+//
+// Frames that are not pushed are counted as either "skipped" (nothing changed)
+// or "throttled" (something changed, but it's too soon after the last push).
+// A throttled frame stays dirty, so it will be pushed on a later call.
+
+// How much of the strip gets sent when a frame is pushed.
+//
+// WS2812 pixels latch whatever they were last sent and keep it if fewer bytes
+// are clocked out on the next frame.  So in the dirtyPrefix mode, we only send
+// the pixels up to (and including) the last one that changed.  Brightness is
+// applied to every pixel, so a brightness change always sends the whole strip.
+namespace RenderMode {
+  enum Values {
+    fullFrame   = 0, // FastLED.show() -- every pixel on every controller
+    dirtyPrefix = 1  // only the changed prefix of our own controller
+  };
+}
+
+template <unsigned int NumLEDs>
+struct StripRenderer {
+  struct CRGB shownLeds[NumLEDs];      // the pixels as of the last push
+  int shownBrightness;                 // the brightness as of the last push
+  bool hasShown;                       // whether anything has been pushed at all
+  unsigned long lastShowTime;          // when the last push happened
+  unsigned int minFrameIntervalMs;     // the fastest we are allowed to push frames
+  RenderMode::Values mode;             // how much of the strip to send on a push
+  CLEDController* controller;          // the strip itself, needed for the dirtyPrefix mode
+
+  unsigned long framesPushed;          // frames that went out to the strip
+  unsigned long framesSkipped;         // frames that were identical to what's already shown
+  unsigned long framesThrottled;       // frames that changed but arrived too soon
+  unsigned long pixelsPushed;          // total pixels sent to the strip
+
+  StripRenderer(unsigned int minIntervalMs) :
+    minFrameIntervalMs(minIntervalMs),
+    mode(RenderMode::Values::fullFrame),
+    controller(nullptr)
+  {
+    reset();
+  }
+
+  // forget what's on the strip, so that the next render is guaranteed to push
+  void reset() {
+    hasShown        = false;
+    shownBrightness = 0;
+    lastShowTime    = 0;
+    framesPushed    = 0;
+    framesSkipped   = 0;
+    framesThrottled = 0;
+    pixelsPushed    = 0;
+  }
+
+  // the number of pixels (from the start of the strip) that would need to be sent
+  // to make the strip match the given frame.  0 means the frame is already shown
+  unsigned int dirtyLength(const struct CRGB* leds, int brightness) const {
+    if (!hasShown || brightness != shownBrightness) return NumLEDs;
+    for (unsigned int i = NumLEDs; i > 0; --i) {
+      if (leds[i - 1] != shownLeds[i - 1]) return i;
+    }
+    return 0;
+  }
+
+  // whether the given frame differs from the one on the strip
+  inline bool isDirty(const struct CRGB* leds, int brightness) const {
+    return 0 < dirtyLength(leds, brightness);
+  }
+
+  // whether enough time has passed since the last push
+  inline bool isDue(unsigned long const &nMillis) const {
+    return !hasShown || (nMillis - lastShowTime) >= minFrameIntervalMs;
+  }
+
+  // push the frame to the strip if it's changed and we're allowed to.  returns whether we pushed
+  bool render(CFastLED* fastLed, const struct CRGB* leds, int brightness, unsigned long const &nMillis) {
+    unsigned int length = dirtyLength(leds, brightness);
+    if (!length) {
+      ++framesSkipped;
+      return false;
+    }
+
+    if (!isDue(nMillis)) {
+      ++framesThrottled;
+      return false;
+    }
+
+    if (mode == RenderMode::Values::dirtyPrefix && controller) {
+      controller->show(leds, length, brightness);
+    } else {
+      fastLed->setBrightness(brightness);
+      fastLed->show();
+      length = NumLEDs;
+    }
+
+    for (unsigned int i = 0; i < length; ++i) shownLeds[i] = leds[i];
+    shownBrightness = brightness;
+    lastShowTime    = nMillis;
+    hasShown        = true;
+    pixelsPushed   += length;
+    ++framesPushed;
+    return true;
+  }
+
+  // summary of the render statistics
+  String toString() const {
+    char ret[sizeof("px  sk  th  pix ") + 4 * ULONG_TEXT_DIGITS];
+    snprintf(ret, sizeof(ret), "px %lu sk %lu th %lu pix %lu", framesPushed, framesSkipped, framesThrottled, pixelsPushed);
+    return String(ret);
+  }
+};
@@ -0,0 +1,58 @@
+#include <ArduinoUnitTests.h>
+#include "../src/CalibratedServo.h"
+
+const Range testInput  { 0, 1000 };
+const Range testOutput { 10, 110 };
+
+unittest(positions_are_mapped_and_limited)
+{
+  CalibratedServo s(3, testInput, testOutput);
+  s.setup();
+  assertEqual(3, s.servo.pin);
+
+  s.write(500);
+  assertEqual(60, s.servo.pos);
+  s.writeMin();
+  assertEqual(10, s.servo.pos);
+  s.writeMax();
+  assertEqual(110, s.servo.pos);
+}
+
+unittest(every_write_reaches_the_servo)
+{
+  CalibratedServo s(3, testInput, testOutput);
+  s.setup();
+
+  // the same position, over and over, is passed on every time
+  for (unsigned int i = 0; i < 100; ++i) s.write(500);
+  assertEqual(100, s.servo.writes);
+  assertEqual(99, s.servo.rewrites);
+
+  // and inputs that map to the same position are the same position
+  s.write(505);
+  assertEqual(101, s.servo.writes);
+  assertEqual(100, s.servo.rewrites);
+
+  s.write(600);
+  s.writeMax();
+  assertEqual(110, s.servo.recentWrite(0));
+  assertEqual(70, s.servo.recentWrite(1));
+  assertEqual(60, s.servo.recentWrite(2));
+  assertEqual(100, s.servo.rewrites);
+}
+
+unittest(clearing_the_log_keeps_the_position)
+{
+  CalibratedServo s(3, testInput, testOutput);
+  s.setup();
+  s.write(500);
+  s.servo.clearLog();
+
+  // the servo is still where it was, so writing it there again is still a rewrite
+  s.write(500);
+  assertEqual(1, s.servo.writes);
+  assertEqual(1, s.servo.rewrites);
+  assertEqual(60, s.servo.recentWrite(0));
+}
+
+unittest_main()
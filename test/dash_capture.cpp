@@ -0,0 +1,221 @@
+#include <ArduinoUnitTests.h>
+#include "../src/DashCapture.h"
+#include "../src/DashState.h"
+
+// mock a FastLED object
+CFastLED FastLED;
+
+int fakeDigitalRead(unsigned char pin) {
+  return digitalRead(pin);
+}
+
+void fakeDigitalWrite(pin_size_t pin, int val) {
+  return digitalWrite(pin, val);
+}
+
+DashSupport ds = {
+  pinMode,
+  analogRead,
+  fakeDigitalRead,
+  fakeDigitalWrite,
+  &FastLED
+};
+
+// somewhere to record to
+typedef struct CaptureBuffer {
+  byte data[4096];
+  unsigned long length;
+
+  CaptureBuffer() : length(0) {}
+  size_t write(uint8_t b) {
+    if (length >= sizeof(data)) return 0;
+    data[length++] = b;
+    return 1;
+  }
+} CaptureBuffer;
+
+SlaveState sampleOf(bool ignition, bool dim, int fuel, int temperature, int oil) {
+  SlaveState ret;
+  ret.ignition = ignition;
+  ret.backlightDim = dim;
+  ret.fuelLevel = fuel;
+  ret.temperatureLevel = temperature;
+  ret.oilPressureLevel = oil;
+  return ret;
+}
+
+// a cheap fingerprint of what the dash is showing
+unsigned long fingerprint(DashState const &d) {
+  unsigned long ret = d.lastState.signals();
+  for (unsigned int i = 0; i < NUM_DASH_LEDS; ++i) {
+    ret = ret * 31 + d.leds[i].r;
+    ret = ret * 31 + d.leds[i].g;
+    ret = ret * 31 + d.leds[i].b;
+  }
+  return ret * 31 + d.fuelGauge.servo.pos;
+}
+
+unittest(unchanged_loops_cost_a_byte)
+{
+  CaptureBuffer buf;
+  DashCaptureWriter<CaptureBuffer> writer(buf);
+  writer.begin();
+  assertEqual(DASH_CAPTURE_HEADER_LENGTH, buf.length);
+
+  SlaveState s = sampleOf(true, false, 100, 200, 300);
+  writer.record(s, 1000); // a message and a sample, the first with a long time
+  assertEqual(DASH_CAPTURE_HEADER_LENGTH + (1 + 2 + DashMessage::length) + (1 + DASH_CAPTURE_SAMPLE_LENGTH), buf.length);
+
+  const unsigned long before = buf.length;
+  for (unsigned long t = 1003; t < 1100; t += 3) writer.record(s, t);
+  assertEqual(before + 33, buf.length);
+  assertEqual(2 + 33, writer.records);
+  assertEqual(buf.length, writer.bytes);
+}
+
+unittest(capture_round_trip)
+{
+  CaptureBuffer buf;
+  DashCaptureWriter<CaptureBuffer> writer(buf);
+  writer.begin();
+
+  DashMessage dm;
+  dm.setBit(MasterSignal::Values::acOn, true);
+  dm.setField<MasterField::boostPressure>(9);
+  SlaveState s = sampleOf(true, true, 0, 512, 1023);
+  s.tachometerWarning = true;
+  s.masterMessage = dm;
+  writer.record(s, 5);
+  writer.record(s, 8);
+  s.fuelLevel = 2000;           // out of range for a sample: it's clamped
+  writer.record(s, 100008);     // after a long gap
+  s.masterMessage = DashMessage();
+  writer.record(s, 100009);
+
+  DashCaptureReader reader(buf.data, buf.length);
+  assertTrue(reader.begin());
+
+  assertTrue(reader.next());
+  assertEqual(DashCaptureRecord::Values::message, reader.kind);
+  assertEqual(5, reader.time);
+  assertEqual(dm.binaryString(), reader.message.binaryString());
+
+  assertTrue(reader.next());
+  assertEqual(DashCaptureRecord::Values::sample, reader.kind);
+  assertEqual(5, reader.time);
+  assertTrue(reader.sample.ignition);
+  assertTrue(reader.sample.backlightDim);
+  assertTrue(reader.sample.tachometerWarning);
+  assertFalse(reader.sample.tachometerCritical);
+  assertEqual(0, reader.sample.fuelLevel);
+  assertEqual(512, reader.sample.temperatureLevel);
+  assertEqual(1023, reader.sample.oilPressureLevel);
+
+  assertTrue(reader.next());
+  assertEqual(DashCaptureRecord::Values::apply, reader.kind);
+  assertEqual(8, reader.time);
+
+  assertTrue(reader.next());
+  assertEqual(DashCaptureRecord::Values::sample, reader.kind);
+  assertEqual(100008, reader.time);
+  assertEqual(1023, reader.sample.fuelLevel);
+
+  assertTrue(reader.next());
+  assertEqual(DashCaptureRecord::Values::message, reader.kind);
+  assertEqual(100009, reader.time);
+  assertEqual(DashMessage().binaryString(), reader.message.binaryString());
+
+  assertTrue(reader.next());
+  assertEqual(DashCaptureRecord::Values::apply, reader.kind);
+
+  assertFalse(reader.next());
+  assertFalse(reader.error);
+}
+
+unittest(malformed_captures_are_refused)
+{
+  CaptureBuffer buf;
+  DashCaptureWriter<CaptureBuffer> writer(buf);
+  writer.begin();
+  writer.record(sampleOf(true, false, 1, 2, 3), 70000);
+
+  // a header from somewhere else
+  for (unsigned int i = 0; i < DASH_CAPTURE_HEADER_LENGTH; ++i) {
+    CaptureBuffer bad = buf;
+    bad.data[i] ^= 0x01;
+    DashCaptureReader reader(bad.data, bad.length);
+    assertFalse(reader.begin());
+    assertFalse(reader.next());
+  }
+
+  // cut short anywhere in a record
+  unsigned int records = 0;
+  for (unsigned long cut = DASH_CAPTURE_HEADER_LENGTH; cut < buf.length; ++cut) {
+    DashCaptureReader reader(buf.data, cut);
+    assertTrue(reader.begin());
+    while (reader.next()) ++records;
+  }
+  assertEqual(buf.length - DASH_CAPTURE_HEADER_LENGTH - (1 + DASH_CAPTURE_SAMPLE_LENGTH), records); // only the whole message survives
+  DashCaptureReader truncated(buf.data, buf.length - 1);
+  truncated.begin();
+  assertTrue(truncated.next());
+  assertFalse(truncated.next());
+  assertTrue(truncated.error);
+
+  // a kind that doesn't exist, and a time that never ends
+  const byte unknown[] = { 'M', 'D', 'C', DASH_CAPTURE_VERSION, DashMessage::length, 0xC0 };
+  DashCaptureReader reader(unknown, sizeof(unknown));
+  assertTrue(reader.begin());
+  assertFalse(reader.next());
+  assertTrue(reader.error);
+
+  const byte endless[] = { 'M', 'D', 'C', DASH_CAPTURE_VERSION, DashMessage::length, 0x7F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01 };
+  DashCaptureReader forever(endless, sizeof(endless));
+  assertTrue(forever.begin());
+  assertFalse(forever.next());
+  assertTrue(forever.error);
+}
+
+unittest(replay_reproduces_the_dash)
+{
+  CaptureBuffer buf;
+  DashCaptureWriter<CaptureBuffer> writer(buf);
+  writer.begin();
+
+  // drive a dash by hand, recording it as the slave would, and noting what it showed
+  DashState live(ds);
+  live.setup();
+  const unsigned int LOOPS = 300;
+  unsigned long shown[LOOPS];
+  for (unsigned int i = 0; i < LOOPS; ++i) {
+    const unsigned long t = 7 + i * 13;
+    DashMessage dm;
+    dm.setBit(MasterSignal::Values::acOn, (i / 40) % 2);
+    dm.setBit(MasterSignal::Values::scrollRainbowEffects, (i / 25) % 3 == 1);
+    dm.setBit(MasterSignal::Values::hazardOff, i > 250);
+    if (i % 7 == 0) live.postMessage(dm, t);
+    live.state().setInputs(sampleOf(i < 280, (i / 60) % 2, i * 3, 500, 1000 - i));
+    live.apply(t);
+    writer.record(live.state(), t);
+    shown[i] = fingerprint(live);
+  }
+
+  // and play it back into another
+  DashState replayed(ds);
+  replayed.setup();
+  DashCaptureReader reader(buf.data, buf.length);
+  assertTrue(reader.begin());
+  unsigned int applies = 0;
+  while (reader.next()) {
+    if (reader.replay(replayed)) {
+      assertEqual(7 + applies * 13, reader.time);
+      assertEqual(shown[applies], fingerprint(replayed));
+      ++applies;
+    }
+  }
+  assertFalse(reader.error);
+  assertEqual(LOOPS, applies);
+  assertEqual(live.lastState.toString(), replayed.lastState.toString()); // the I2C statistics aren't replayed
+}
+
+unittest_main()
@@ -0,0 +1,82 @@
+#include <ArduinoUnitTests.h>
+#include "../src/DashMailbox.h"
+
+DashMessage messageWith(MasterSignal::Values signal) {
+  DashMessage dm;
+  dm.setBit(signal, true);
+  return dm;
+}
+
+unittest(empty_mailbox_has_nothing_to_take)
+{
+  DashMailbox mb;
+  DashMessage dm;
+  assertFalse(mb.take(dm));
+  assertEqual(0, mb.counts().posted);
+  assertEqual(0, mb.sequence % 2);
+}
+
+unittest(posted_message_is_taken_once)
+{
+  DashMailbox mb;
+  DashMessage dm;
+  mb.post(messageWith(MasterSignal::Values::acOn));
+  assertEqual(0, mb.sequence % 2);
+
+  assertTrue(mb.take(dm));
+  assertTrue(dm.getBit(MasterSignal::Values::acOn));
+  assertFalse(dm.getBit(MasterSignal::Values::hazardOff));
+
+  // the same message isn't new the second time
+  assertFalse(mb.take(dm));
+  assertTrue(dm.getBit(MasterSignal::Values::acOn));
+  assertEqual(1, mb.counts().posted);
+  assertEqual(0, mb.counts().overwritten);
+}
+
+unittest(only_the_latest_message_is_kept)
+{
+  DashMailbox mb;
+  DashMessage dm;
+  mb.post(messageWith(MasterSignal::Values::acOn));
+  mb.post(messageWith(MasterSignal::Values::hazardOff));
+  mb.post(messageWith(MasterSignal::Values::rearFoggerOn));
+
+  assertTrue(mb.take(dm));
+  assertFalse(dm.getBit(MasterSignal::Values::acOn));
+  assertFalse(dm.getBit(MasterSignal::Values::hazardOff));
+  assertTrue(dm.getBit(MasterSignal::Values::rearFoggerOn));
+
+  const MailboxCounts c = mb.counts();
+  assertEqual(3, c.posted);
+  assertEqual(2, c.overwritten);
+  assertEqual(0, c.dropped);
+}
+
+unittest(dropped_messages_are_counted)
+{
+  DashMailbox mb;
+  DashMessage dm;
+  mb.drop();
+  mb.drop();
+  assertFalse(mb.take(dm));
+  assertEqual(2, mb.counts().dropped);
+  assertEqual(String("msg 0 0 2"), mb.toString());
+}
+
+unittest(serial_wraps_around)
+{
+  // the serial is a single byte; a message is still new after 256 of them
+  DashMailbox mb;
+  DashMessage dm;
+  for (unsigned int i = 0; i < 300; ++i) {
+    mb.post(messageWith(i % 2 ? MasterSignal::Values::acOn : MasterSignal::Values::hazardOff));
+    assertTrue(mb.take(dm));
+    assertEqual(i % 2, dm.getBit(MasterSignal::Values::acOn));
+    assertFalse(mb.take(dm));
+  }
+  assertEqual(300, mb.counts().posted);
+  assertEqual(0, mb.counts().overwritten);
+}
+
+unittest_main()
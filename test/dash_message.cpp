@@ -310,5 +310,402 @@ unittest(received_unsynced_payload)
   assertTrue( d.getBit(MasterSignal::Values::scrollBrightness));
 }
 
+unittest(wire_protocol_length_follows_the_signals)
+{
+  // 7 signals per byte, worked out at compile time
+  static_assert(DashMessage::length == wireProtocolLength(MASTER_PAYLOAD_BITS), "length comes from the signals and fields");
+  static_assert(DashMessageOf<7>::length == 1, "7 signals fit in a byte");
+  static_assert(DashMessageOf<8>::length == 2, "the 8th signal needs another byte");
+  static_assert(DashMessage::byteOf(MasterSignal::Values::scrollCAN) == 0, "bit positions are constants");
+  static_assert(DashMessage::maskOf(MasterSignal::Values::scrollPresetColours) == 0b00000001, "bit positions are constants");
+  assertEqual(2, WIRE_PROTOCOL_MESSAGE_LENGTH);
+
+  // a longer message frames and packs the same way
+  bool data[15] = { false };
+  data[0]  = true;
+  data[7]  = true;
+  data[14] = true;
+  DashMessageOf<15> d(data, 15);
+  assertEqual(3, sizeof(d.rawData));
+  assertEqual(0b10000001, d.rawData[0]);
+  assertEqual(0b00000001, d.rawData[1]);
+  assertEqual(0b00000001, d.rawData[2]);
+  assertFalse(d.isError());
+  assertEqual(String("0b000000100000010000001"), d.binaryString());
+}
+
+// the fields of a made-up, longer message: each starts where the last ends, across byte boundaries
+typedef MasterFieldOf<3, 4>                  FourBits;
+typedef MasterFieldOf<FourBits::end, 7>      SevenBits;
+typedef MasterFieldOf<SevenBits::end, 10>    TenBits;
+typedef MasterFieldOf<TenBits::end, 1>       OneBit;
+typedef DashMessageOf<OneBit::end>           FieldMessage;
+
+// read a field the slow way, a bit at a time
+template <typename Field>
+uint16_t fieldBitByBit(FieldMessage const &m) {
+  uint16_t ret = 0;
+  for (unsigned int b = 0; b < Field::width; ++b) {
+    const unsigned int p = Field::position + b;
+    if (m.rawData[p / 7] & (1 << (p % 7))) ret |= 1 << b;
+  }
+  return ret;
+}
+
+unittest(fields_pack_across_bytes)
+{
+  static_assert(FieldMessage::length == 4, "22 payload bits need 4 bytes");
+  FieldMessage m;
+  for (uint16_t v = 0; v < 1024; v += 7) {
+    m.setField<FourBits>(v & FourBits::maxValue);
+    m.setField<SevenBits>(v & SevenBits::maxValue);
+    m.setField<TenBits>(v);
+    m.setField<OneBit>(v & 1);
+
+    assertEqual(v & FourBits::maxValue,  m.getField<FourBits>());
+    assertEqual(v & SevenBits::maxValue, m.getField<SevenBits>());
+    assertEqual(v,                       m.getField<TenBits>());
+    assertEqual(v & 1,                   m.getField<OneBit>());
+    assertEqual(fieldBitByBit<TenBits>(m), m.getField<TenBits>());
+    assertEqual(fieldBitByBit<SevenBits>(m), m.getField<SevenBits>());
+
+    // the framing and the bits before the first field are untouched
+    assertFalse(m.isError());
+    for (unsigned int i = 1; i < FieldMessage::length; ++i) assertEqual(0, m.rawData[i] & FIRST_FRAME_MARKER_MASK);
+    assertEqual(0, m.rawData[0] & 0b00000111);
+  }
+}
+
+unittest(fields_leave_their_neighbours_alone)
+{
+  FieldMessage m;
+  m.setField<SevenBits>(SevenBits::maxValue);
+  assertEqual(0, m.getField<FourBits>());
+  assertEqual(0, m.getField<TenBits>());
+  m.setField<SevenBits>(0);
+  m.setField<FourBits>(FourBits::maxValue);
+  m.setField<TenBits>(TenBits::maxValue);
+  assertEqual(0, m.getField<SevenBits>());
+
+  // too big for the field: the largest value it can hold
+  m.setField<FourBits>(100);
+  assertEqual(15, m.getField<FourBits>());
+}
+
+unittest(boost_pressure_rides_along_with_the_signals)
+{
+  DashMessage dm;
+  dm.setBit(MasterSignal::Values::scrollBrightness, true);
+  dm.setField<MasterField::boostPressure>(MasterField::boostPressure::fromAnalog(1023));
+  assertEqual(15, dm.getField<MasterField::boostPressure>());
+  assertTrue(dm.getBit(MasterSignal::Values::scrollBrightness));
+  assertFalse(dm.getBit(MasterSignal::Values::scrollRainbowEffects));
+  assertEqual(String("0b11111000000000"), dm.binaryString());
+
+  // quantizing a reading and spreading it back out
+  assertEqual(0,    MasterField::boostPressure::fromAnalog(63));
+  assertEqual(1,    MasterField::boostPressure::fromAnalog(64));
+  assertEqual(0,    MasterField::boostPressure::toAnalog(0));
+  assertEqual(1023, MasterField::boostPressure::toAnalog(15));
+  assertEqual(512,  TenBits::fromAnalog(512));
+  assertEqual(512,  TenBits::toAnalog(512));
+
+  // with hysteresis, a reading on the edge between two values doesn't flicker between them
+  uint16_t boost = MasterField::boostPressure::fromAnalog(63);
+  for (int i = 0; i < 100; ++i) {
+    boost = MasterField::boostPressure::fromAnalog(i % 2 ? 63 : 64, boost);
+    assertEqual(0, boost);
+  }
+  assertEqual(0,  MasterField::boostPressure::fromAnalog(64 + MASTER_FIELD_DEADBAND - 1, 0));
+  assertEqual(1,  MasterField::boostPressure::fromAnalog(64 + MASTER_FIELD_DEADBAND, 0));
+  assertEqual(1,  MasterField::boostPressure::fromAnalog(64 - MASTER_FIELD_DEADBAND, 1));
+  assertEqual(0,  MasterField::boostPressure::fromAnalog(63 - MASTER_FIELD_DEADBAND, 1));
+  assertEqual(15, MasterField::boostPressure::fromAnalog(1023, 0));    // a big move is taken at once
+  assertEqual(512, TenBits::fromAnalog(512 + MASTER_FIELD_DEADBAND, 512));
+  assertEqual(513 + MASTER_FIELD_DEADBAND, TenBits::fromAnalog(513 + MASTER_FIELD_DEADBAND, 512));
+}
+
+unittest(sender_sends_changes_and_heartbeats)
+{
+  const int addr = 7;
+  Wire.resetMocks();
+  deque<uint8_t>* mosi = Wire.getMosi(addr);
+  Wire.begin();
+
+  DashSender sender(5, 100);
+  DashMessage idle;
+  DashMessage ac;
+  ac.setBit(MasterSignal::Values::acOn, true);
+
+  // the first sample always goes out, and then nothing until the heartbeat
+  assertTrue(sender.process(Wire, addr, idle, 1000));
+  for (unsigned long t = 1001; t < 1100; ++t) assertFalse(sender.process(Wire, addr, idle, t));
+  assertEqual(2, mosi->size());
+  assertTrue(sender.process(Wire, addr, idle, 1100));
+  assertEqual(1, sender.heartbeats);
+
+  // a change goes out right away
+  assertTrue(sender.process(Wire, addr, ac, 1150));
+  assertEqual(6, mosi->size());
+  assertEqual(1, sender.heartbeats);
+
+  // but not sooner than the minimum gap after the last frame
+  assertFalse(sender.process(Wire, addr, idle, 1151));
+  assertFalse(sender.process(Wire, addr, idle, 1154));
+  assertTrue(sender.process(Wire, addr, idle, 1155));
+  assertTrue(idle == sender.lastSent);
+
+  // every sample is accounted for
+  assertEqual(105, sender.samples);
+  assertEqual(4, sender.framesSent);
+  assertEqual(2, sender.framesThrottled);
+  assertEqual(99, sender.framesSkipped);
+  assertEqual(sender.samples, sender.framesSent + sender.framesSkipped + sender.framesThrottled);
+  assertEqual(String("tx 4/105 hb 1 th 2 nak 0 re 0"), sender.toString());
+
+  // and the summary has room for the biggest counts a board can have
+  sender.framesSent = sender.samples = sender.heartbeats = sender.framesThrottled = sender.nacks = sender.retries = 4294967295ul;
+  assertEqual(String("tx 4294967295/4294967295 hb 4294967295 th 4294967295 nak 4294967295 re 4294967295"), sender.toString());
+}
+
+unittest(sender_survives_millis_rollover)
+{
+  const int addr = 7;
+  Wire.resetMocks();
+  Wire.begin();
+
+  DashSender sender(5, 100);
+  DashMessage idle;
+  const unsigned long beforeRollover = 0ul - 16;
+  assertTrue(sender.process(Wire, addr, idle, beforeRollover));
+  assertFalse(sender.process(Wire, addr, idle, 16));
+  assertTrue(sender.process(Wire, addr, idle, 84));
+}
+
+
+// a bus that refuses some transmissions, like a slave that isn't listening
+struct FlakyBus {
+  unsigned int transmissions = 0;
+  unsigned int bytes = 0;
+  uint8_t status = 0;
+  void beginTransmission(int) { ++transmissions; }
+  size_t write(uint8_t) { ++bytes; return 1; }
+  uint8_t endTransmission() { return status; }
+};
+
+unittest(sender_counts_nacks_and_retries)
+{
+  FlakyBus bus;
+  DashSender sender(5, 100);
+  DashMessage idle;
+
+  // an unacknowledged frame is tried again after the gap, even though nothing changed
+  bus.status = 2;
+  assertTrue(sender.process(bus, 7, idle, 1000));
+  assertFalse(sender.process(bus, 7, idle, 1004));
+  assertTrue(sender.process(bus, 7, idle, 1005));
+  assertEqual(2, sender.nacks);
+  assertEqual(1, sender.retries);
+
+  // once it gets through, it's back to heartbeats
+  bus.status = 0;
+  assertTrue(sender.process(bus, 7, idle, 1010));
+  assertFalse(sender.process(bus, 7, idle, 1015));
+  assertEqual(2, sender.nacks);
+  assertEqual(2, sender.retries);
+  assertEqual(0, sender.heartbeats);
+  assertEqual(3, bus.transmissions);
+  assertEqual(3 * WIRE_PROTOCOL_MESSAGE_LENGTH, bus.bytes);
+}
+
+unittest(numbered_frames_carry_a_sequence)
+{
+  const int addr = 7;
+  Wire.resetMocks();
+  deque<uint8_t>* mosi = Wire.getMosi(addr);
+  Wire.begin();
+
+  DashSender sender(5, 100, true);
+  DashDecoder decoder(true);
+  DashMessage dm;
+  for (unsigned int i = 0; i < 300; ++i) {
+    dm.setBit(MasterSignal::Values::acOn, i % 2);
+    assertTrue(sender.process(Wire, addr, dm, 10 * i));
+    assertEqual(WIRE_PROTOCOL_MESSAGE_LENGTH + 1, mosi->size());
+
+    // the decoder hands back the frame, then its number
+    for (unsigned int b = 0; b < WIRE_PROTOCOL_MESSAGE_LENGTH; ++b) {
+      decoder.push(mosi->front());
+      mosi->pop_front();
+    }
+    assertEqual(i % 2, decoder.message.getBit(MasterSignal::Values::acOn));
+    assertEqual(DashDecoder::Event::sequence, decoder.push(mosi->front()));
+    mosi->pop_front();
+    assertEqual(i % 128, decoder.lastSequence);
+  }
+  assertEqual(300, decoder.frames);
+  assertEqual(0, decoder.resyncs);
+  assertEqual(0, decoder.skipped);
+}
+
+unittest(sequence_bytes_are_errors_to_a_reader_that_does_not_expect_them)
+{
+  const byte fakePayload[] = { 42 + FIRST_FRAME_MARKER_MASK, 5, 17 }; // a frame, then its number
+  Wire.resetMocks();
+  const int fakeSlaveAddr = 7;
+  Wire.begin();
+  deque<uint8_t>* miso = Wire.getMiso(fakeSlaveAddr);
+  for (unsigned int i = 0; i < sizeof(fakePayload); ++i) miso->push_back(fakePayload[i]);
+  assertEqual(3, Wire.requestFrom(fakeSlaveAddr, 3));
+
+  // setFromWire() takes the frame and leaves the number, which is an error if it's read
+  DashMessage d(Wire);
+  assertFalse(d.isError());
+  assertEqual(1, Wire.available());
+  DashMessage d2(Wire);
+  assertTrue(d2.isError());
+
+  // and to a decoder that isn't expecting numbers, it's a loss of framing
+  DashDecoder decoder;
+  assertEqual(DashDecoder::Event::none, decoder.push(fakePayload[0]));
+  assertEqual(DashDecoder::Event::frame, decoder.push(fakePayload[1]));
+  assertEqual(DashDecoder::Event::dropped, decoder.push(fakePayload[2]));
+  assertEqual(1, decoder.resyncs);
+}
+
+unittest(unnumbered_decoder_never_reports_a_sequence)
+{
+  DashMessage dm;
+  dm.setBit(MasterSignal::Values::acOn, true);
+  DashMessage flipped = dm;
+  flipped.rawData[0] ^= FIRST_FRAME_MARKER_MASK;
+
+  // a frame that lost its marker bit, straight after a good one, looks just like a sequence
+  // number.  from an unnumbered master it's only a lost frame
+  DashDecoder decoder;
+  unsigned int drops = 0;
+  for (unsigned int f = 0; f < 3; ++f) {
+    const DashMessage &sent = f == 1 ? flipped : dm;
+    for (unsigned int i = 0; i < WIRE_PROTOCOL_MESSAGE_LENGTH; ++i) {
+      const DashDecoder::Event e = decoder.push(sent.rawData[i]);
+      assertNotEqual(DashDecoder::Event::sequence, e);
+      if (e == DashDecoder::Event::dropped) ++drops;
+    }
+  }
+  assertEqual(2, decoder.frames);
+  assertEqual(1, drops);
+  assertEqual(WIRE_PROTOCOL_MESSAGE_LENGTH, decoder.skipped);
+}
+
+unittest(decoder_reads_frames_a_byte_at_a_time)
+{
+  DashDecoder decoder;
+  DashMessage dm;
+  dm.setBit(MasterSignal::Values::acOn, true);
+  dm.setBit(MasterSignal::Values::scrollBrightness, true);
+
+  // split across "transactions" however the bytes happen to arrive
+  for (unsigned int i = 0; i + 1 < WIRE_PROTOCOL_MESSAGE_LENGTH; ++i) {
+    assertEqual(DashDecoder::Event::none, decoder.push(dm.rawData[i]));
+  }
+  assertEqual(DashDecoder::Event::frame, decoder.push(dm.rawData[WIRE_PROTOCOL_MESSAGE_LENGTH - 1]));
+  assertEqual(dm.binaryString(), decoder.message.binaryString());
+  assertFalse(decoder.message.isError());
+  assertEqual(String("rx 1 rs 0 sk 0"), decoder.toString());
+
+  // and the summary has room for the biggest counts a board can have
+  decoder.frames = decoder.resyncs = decoder.skipped = 4294967295ul;
+  assertEqual(String("rx 4294967295 rs 4294967295 sk 4294967295"), decoder.toString());
+}
+
+unittest(decoder_resyncs_on_the_next_frame)
+{
+  DashDecoder decoder;
+  DashMessage dm;
+  dm.setBit(MasterSignal::Values::hazardOff, true);
+
+  // leading garbage is skipped, and counted as one loss of framing
+  assertEqual(DashDecoder::Event::dropped, decoder.push(0x01));
+  assertEqual(DashDecoder::Event::none, decoder.push(0x02));
+  for (unsigned int i = 0; i < WIRE_PROTOCOL_MESSAGE_LENGTH; ++i) decoder.push(dm.rawData[i]);
+  assertEqual(1, decoder.frames);
+  assertEqual(1, decoder.resyncs);
+  assertEqual(2, decoder.skipped);
+
+  // a frame cut short by the next one: the partial frame goes, the next one is kept
+  decoder.push(dm.rawData[0]);
+  DashMessage other;
+  other.setBit(MasterSignal::Values::acOn, true);
+  assertEqual(DashDecoder::Event::dropped, decoder.push(other.rawData[0]));
+  for (unsigned int i = 1; i < WIRE_PROTOCOL_MESSAGE_LENGTH; ++i) decoder.push(other.rawData[i]);
+  assertEqual(2, decoder.frames);
+  assertEqual(2, decoder.resyncs);
+  assertEqual(other.binaryString(), decoder.message.binaryString());
+}
+
+unittest(decoder_loses_at_most_one_frame_per_bit_error)
+{
+  // a long stream of frames, with a bit flipped in every 10th one
+  const unsigned int numFrames = 2000;
+  DashDecoder decoder;
+  unsigned long seed = 12345;
+  unsigned int flips = 0;
+  unsigned int markerFlips = 0;
+  unsigned int drops = 0;
+  for (unsigned int f = 0; f < numFrames; ++f) {
+    DashMessage dm;
+    for (unsigned int s = 0; s <= MASTERSIGNAL_MAX; ++s) {
+      seed = seed * 1103515245 + 12345;
+      dm.setBit((MasterSignal::Values)s, (seed >> 16) & 1);
+    }
+    if (f % 10 == 5) {
+      seed = seed * 1103515245 + 12345;
+      const unsigned int bit = (seed >> 16) % (8 * WIRE_PROTOCOL_MESSAGE_LENGTH);
+      dm.rawData[bit / 8] ^= (1 << (bit % 8));
+      ++flips;
+      if (bit % 8 == 7) ++markerFlips;
+    }
+    for (unsigned int i = 0; i < WIRE_PROTOCOL_MESSAGE_LENGTH; ++i) {
+      if (decoder.push(dm.rawData[i]) == DashDecoder::Event::dropped) ++drops;
+    }
+  }
+
+  // a flipped payload bit can't be seen, and costs nothing; a flipped marker costs that one frame
+  const unsigned long lost = numFrames - decoder.frames;
+  assertEqual(200, flips);
+  assertMore(markerFlips, 0);
+  assertEqual(markerFlips, lost);
+  assertEqual(lost, drops);
+  assertLessOrEqual(lost, flips);
+}
+
+unittest(decoder_reports_one_drop_per_lost_frame)
+{
+  DashMessage dm;
+  dm.setBit(MasterSignal::Values::acOn, true);
+  DashDecoder decoder;
+  for (unsigned int i = 0; i < WIRE_PROTOCOL_MESSAGE_LENGTH; ++i) decoder.push(dm.rawData[i]);
+
+  // the marker bit flipped in the second byte: the frame is cut short there, and a bogus one
+  // starts, which the next good frame cuts short in turn.  that's one frame lost, not two
+  DashMessage flipped = dm;
+  flipped.rawData[1] ^= FIRST_FRAME_MARKER_MASK;
+  unsigned int drops = 0;
+  for (unsigned int f = 0; f < 3; ++f) {
+    const DashMessage &sent = f == 0 ? flipped : dm;
+    for (unsigned int i = 0; i < WIRE_PROTOCOL_MESSAGE_LENGTH; ++i) {
+      if (decoder.push(sent.rawData[i]) == DashDecoder::Event::dropped) ++drops;
+    }
+  }
+  assertEqual(1, drops);
+  assertEqual(1, decoder.resyncs);
+  assertEqual(3, decoder.frames);
+
+  // and after a good frame, the next loss is reported again
+  decoder.push(dm.rawData[0]);
+  assertEqual(DashDecoder::Event::dropped, decoder.push(dm.rawData[0]));
+  assertEqual(2, decoder.resyncs);
+}
+
 
 unittest_main()
@@ -136,6 +136,28 @@ unittest(digital_raw_signals_to_state)
   }
 }
 
+unittest(posted_messages_take_effect_on_apply)
+{
+  // a message from the I2C receiver waits in the mailbox until the next apply()
+  DashMessage dm;
+  dm.setBit(MasterSignal::Values::acOn, true);
+  dash.postMessage(dm);
+  assertFalse(dash.state().masterMessage.getBit(MasterSignal::Values::acOn));
+
+  dash.apply(35);
+  assertTrue(dash.state().masterMessage.getBit(MasterSignal::Values::acOn));
+  assertTrue(dash.lastState.masterMessage.getBit(MasterSignal::Values::acOn));
+
+  // once it's been taken, a direct setMessage isn't undone by it
+  dash.setMessage(DashMessage());
+  dash.apply(36);
+  assertFalse(dash.state().masterMessage.getBit(MasterSignal::Values::acOn));
+
+  dash.dropMessage();
+  assertEqual(1, dash.mailbox.counts().posted);
+  assertEqual(1, dash.mailbox.counts().dropped);
+}
+
 unittest(digital_debounced_signals_to_state)
 {
   for (int i = 0; i < 2; ++i) {
@@ -163,6 +185,8 @@ unittest(digital_debounced_signals_to_state)
     assertEqual(i,    dash.state().masterMessage.getBit(MasterSignal::Values::scrollRainbowEffects));
     assertEqual(i,    dash.state().masterMessage.getBit(MasterSignal::Values::scrollBrightness));
     assertEqual(0,    dash.state().effectmode.state);
+    assertEqual(0,    dash.lastState.masterMessage.getBit(MasterSignal::Values::scrollCAN)); // what the dash acts on is debounced
+    assertEqual(0,    dash.lastState.masterMessage.getBit(MasterSignal::Values::scrollRainbowEffects));
 
     dash.apply(65);  // more than 50ms later to get the debounce effect
     assertEqual(i,    dash.state().masterMessage.getBit(MasterSignal::Values::scrollCAN));
@@ -170,7 +194,337 @@ unittest(digital_debounced_signals_to_state)
     assertEqual(i,    dash.state().masterMessage.getBit(MasterSignal::Values::scrollRainbowEffects));
     assertEqual(i,    dash.state().masterMessage.getBit(MasterSignal::Values::scrollBrightness));
     assertEqual(i,    dash.state().effectmode.state);
+    assertEqual(i,    dash.lastState.masterMessage.getBit(MasterSignal::Values::scrollCAN));
+    assertEqual(i,    dash.lastState.masterMessage.getBit(MasterSignal::Values::scrollRainbowEffects));
+  }
+}
+
+// run a dash one loop per millisecond, from its first loop until just after the boot animation
+void runPastBoot(DashState &d, unsigned long until = ARDUINO_BOOT_ANIMATION_MS + 100, unsigned long from = 1) {
+  for (unsigned long t = from; t <= until; ++t) d.apply(t);
+}
+
+// run the dash for a simulated second and report how many LED loop()s it took
+unsigned long evaluationsPerSecond(unsigned long startMillis) {
+  const unsigned long before = dash.ledSchedule.evaluations;
+  for (unsigned long t = startMillis; t < startMillis + 1000; ++t) dash.apply(t);
+  return dash.ledSchedule.evaluations - before;
+}
+
+unittest(steady_state_does_not_repeat_show)
+{
+  state->digitalPin[SlavePin::Values::ignitionInput] = 1;
+  dash.setSlaveState(digitalRead, analogRead);
+
+  // get past the boot animation
+  runPastBoot(dash);
+
+  // with nothing changing, one second of loops should push nothing to the strip
+  const unsigned long showsBefore = FastLED.numShows;
+  const unsigned long pushedBefore = dash.renderer.framesPushed;
+  for (unsigned long t = ARDUINO_BOOT_ANIMATION_MS + 101; t <= ARDUINO_BOOT_ANIMATION_MS + 1100; ++t) dash.apply(t);
+  assertEqual(showsBefore,  FastLED.numShows);
+  assertEqual(pushedBefore, dash.renderer.framesPushed);
+
+  // a change in the dimmer is a change in brightness, which must be pushed
+  state->digitalPin[SlavePin::Values::backlightDim] = 1;
+  dash.setSlaveState(digitalRead, analogRead);
+  dash.apply(ARDUINO_BOOT_ANIMATION_MS + 1101);
+  assertEqual(showsBefore + 1, FastLED.numShows);
+  assertEqual(dimBrightnessLevel, FastLED.brightness);
+}
+
+unittest(output_work_is_bounded)
+{
+  DashState local(ds);
+  local.setup();
+  state->digitalPin[SlavePin::Values::ignitionInput] = HIGH;
+  state->analogPin[SlavePin::Values::fuelInput] = 400;
+  local.setSlaveState(digitalRead, analogRead);
+  runPastBoot(local);
+
+  // the gauges are told their position once per loop, and a steady reading holds it steady
+  const unsigned long fuelWrites = local.fuelGauge.servo.writes;
+  const unsigned long fuelRewrites = local.fuelGauge.servo.rewrites;
+  for (unsigned long t = ARDUINO_BOOT_ANIMATION_MS + 101; t <= ARDUINO_BOOT_ANIMATION_MS + 1100; ++t) local.apply(t);
+  assertEqual(fuelWrites + 1000, local.fuelGauge.servo.writes);
+  assertEqual(fuelRewrites + 1000, local.fuelGauge.servo.rewrites);
+  const int fuelPosition = map(400, fuelSenderLimit.min, fuelSenderLimit.max, fuelServoLimit.min, fuelServoLimit.max);
+  for (unsigned int i = 0; i < local.fuelGauge.servo.logged(); ++i) assertEqual(fuelPosition, local.fuelGauge.servo.recentWrite(i));
+
+  // flashing tach LEDs and a rainbow on top never push faster than the frame interval allows,
+  // and never push a frame that's already showing
+  state->digitalPin[SlavePin::Values::tachometerWarning] = HIGH;
+  local.setSlaveState(digitalRead, analogRead);
+  FastLED.controller.clearLog();
+  for (unsigned long t = ARDUINO_BOOT_ANIMATION_MS + 1101; t <= ARDUINO_BOOT_ANIMATION_MS + 3100; ++t) {
+    if (t == ARDUINO_BOOT_ANIMATION_MS + 2101) local.state().effectmode.state = EffectMode::Values::rainbow;
+    state->micros = t * 1000;
+    local.apply(t);
+  }
+  assertLessOrEqual(FastLED.controller.maxPushesWithin(100), 100 / LED_STRIP_MIN_FRAME_MS);
+  assertEqual(100 / LED_STRIP_MIN_FRAME_MS, FastLED.controller.maxPushesWithin(100)); // the rainbow goes as fast as it may
+  assertEqual(0, FastLED.controller.repeatPushes);
+}
+
+unittest(indicator_change_pushes_only_the_prefix)
+{
+  dash.renderer.mode = RenderMode::Values::dirtyPrefix;
+  state->digitalPin[SlavePin::Values::ignitionInput] = 1;
+  dash.setSlaveState(digitalRead, analogRead);
+  runPastBoot(dash);
+
+  // the AC indicator is the only change, so only the pixels up to it are sent
+  const unsigned long pushesBefore = FastLED.controller.numPushes;
+  DashMessage dm;
+  dm.setBit(MasterSignal::Values::acOn, true);
+  dash.setMessage(dm);
+  dash.apply(ARDUINO_BOOT_ANIMATION_MS + 101);
+  assertEqual(pushesBefore + 1, FastLED.controller.numPushes);
+  assertEqual(DashLED::Values::airConditioningInd + 1, FastLED.controller.lastPushPixels);
+
+  dash.renderer.mode = RenderMode::Values::fullFrame;
+}
+
+unittest(led_evaluations_per_second)
+{
+  const unsigned long t0 = ARDUINO_BOOT_ANIMATION_MS + 100;
+  state->digitalPin[SlavePin::Values::ignitionInput] = 1;
+  dash.setSlaveState(digitalRead, analogRead);
+
+  // the first loop looks at everything, and the rest of boot is quiet
+  dash.apply(1);
+  assertEqual(NUM_DASH_LEDS, dash.ledSchedule.evaluations);
+  runPastBoot(dash, t0 - 1, 2);
+  assertEqual(NUM_DASH_LEDS, dash.ledSchedule.evaluations);
+
+  // solid colors need nothing
+  assertEqual(0, evaluationsPerSecond(t0));
+
+  // an input change only looks at the LEDs that subscribe to it
+  DashMessage dm;
+  dm.setBit(MasterSignal::Values::acOn, true);
+  dash.setMessage(dm);
+  assertEqual(1, evaluationsPerSecond(t0 + 1000));
+
+  // 7 tach LEDs flashing at 5Hz switch halves 10 times a second each, plus the change itself
+  state->digitalPin[SlavePin::Values::tachometerWarning] = 1;
+  dash.setSlaveState(digitalRead, analogRead);
+  const unsigned long flashing = evaluationsPerSecond(t0 + 2000);
+  assertMoreOrEqual(flashing, 7 + (7 * 9));
+  assertLessOrEqual(flashing, 7 + (7 * 10));
+
+  // and they keep flashing in step
+  assertEqual(7 * 10, evaluationsPerSecond(t0 + 3000));
+
+  // the rainbow is painted across the whole strip at once, with a new hue every 5ms.
+  // the LEDs' own states aren't looked at while it's on
+  state->digitalPin[SlavePin::Values::tachometerWarning] = 0;
+  dash.setSlaveState(digitalRead, analogRead);
+  dash.state().effectmode.state = EffectMode::Values::rainbow;
+  dash.apply(t0 + 4000);
+  const unsigned long framesBefore = dash.effects.frames;
+  assertEqual(0, evaluationsPerSecond(t0 + 4001));
+  assertEqual(200, dash.effects.frames - framesBefore);
+
+  // and when the effect ends, every LED goes back to its own state
+  dash.state().effectmode.state = EffectMode::Values::none;
+  assertEqual(NUM_DASH_LEDS, evaluationsPerSecond(t0 + 5001));
+  assertEqual(CRGB(COLOR_WHITE), dash.leds[DashLED::Values::clock]);
+}
+
+unittest(flashing_leds_blink_in_step)
+{
+  const unsigned long t0 = ARDUINO_BOOT_ANIMATION_MS + 100;
+  state->digitalPin[SlavePin::Values::ignitionInput] = 1;
+  dash.setSlaveState(digitalRead, analogRead);
+  runPastBoot(dash, t0 - 1);
+
+  // a warning that starts in the quiet half of the flash clock waits for the loud half
+  state->digitalPin[SlavePin::Values::tachometerWarning] = 1;
+  dash.setSlaveState(digitalRead, analogRead);
+  for (unsigned long t = t0; t <= t0 + 50; ++t) dash.apply(t);
+  assertFalse(dash.strip.flash.firstHalf);
+  assertEqual(CRGB(COLOR_WHITE), dash.leds[DashLED::Values::tach0]);
+
+  // a boost critical that starts partway into the loud half joins it
+  for (unsigned long t = t0 + 51; t <= t0 + 130; ++t) dash.apply(t);
+  DashMessage dm;
+  dm.setBit(MasterSignal::Values::boostCritical, true);
+  dash.setMessage(dm);
+  dash.apply(t0 + 131);
+  assertEqual(CRGB(COLOR_RED), dash.leds[DashLED::Values::boostInd]);
+
+  // and from then on, every flashing LED switches on the same ticks
+  for (unsigned long t = t0 + 132; t < t0 + 1000; ++t) {
+    dash.apply(t);
+    const bool loud = dash.strip.flash.firstHalf;
+    assertEqual(CRGB(loud ? COLOR_RED : COLOR_WHITE), dash.leds[DashLED::Values::boostInd]);
+    assertEqual(CRGB(loud ? COLOR_AMBER : COLOR_WHITE), dash.leds[DashLED::Values::tach0]);
+    assertEqual(dash.leds[DashLED::Values::tach0], dash.leds[DashLED::Values::tach6]);
+  }
+}
+
+unittest(inputs_changed_during_shutdown_are_shown)
+{
+  state->digitalPin[SlavePin::Values::ignitionInput] = HIGH;
+  dash.setSlaveState(digitalRead, analogRead);
+  runPastBoot(dash);
+  assertEqual(CRGB(COLOR_BLACK), dash.leds[DashLED::Values::airConditioningInd]);
+
+  // the AC comes on while the dash is shutting down, when the LEDs aren't looked at
+  state->digitalPin[SlavePin::Values::ignitionInput] = LOW;
+  dash.setSlaveState(digitalRead, analogRead);
+  dash.apply(ARDUINO_BOOT_ANIMATION_MS + 101);
+  DashMessage dm;
+  dm.setBit(MasterSignal::Values::acOn, true);
+  dash.setMessage(dm);
+  dash.apply(ARDUINO_BOOT_ANIMATION_MS + 102);
+  assertEqual(CRGB(COLOR_BLACK), dash.leds[DashLED::Values::airConditioningInd]);
+
+  // and it's shown as soon as the ignition is back
+  state->digitalPin[SlavePin::Values::ignitionInput] = HIGH;
+  dash.setSlaveState(digitalRead, analogRead);
+  dash.apply(ARDUINO_BOOT_ANIMATION_MS + 103);
+  assertEqual(CRGB(COLOR_BLUE), dash.leds[DashLED::Values::airConditioningInd]);
+}
+
+unittest(led_input_subscriptions)
+{
+  // each indicator only subscribes to its own signals, plus the effect mode
+  const LEDInputMask effect = ledInputOf(LEDInput::Values::effectMode);
+  assertEqual(effect, dash.statefulLeds.inputMask(DashLED::Values::clock));
+  assertEqual(effect | ledInputOf(MasterSignal::Values::acOn),
+    dash.statefulLeds.inputMask(DashLED::Values::airConditioningInd));
+  assertEqual(effect | ledInputOf(MasterSignal::Values::hazardOff),
+    dash.statefulLeds.inputMask(DashLED::Values::hazardInd));
+  assertEqual(effect | ledInputOf(MasterSignal::Values::boostWarning) | ledInputOf(MasterSignal::Values::boostCritical),
+    dash.statefulLeds.inputMask(DashLED::Values::boostInd));
+  assertEqual(effect | ledInputOf(LEDInput::Values::tachometerWarning) | ledInputOf(LEDInput::Values::tachometerCritical),
+    dash.statefulLeds.inputMask(DashLED::Values::tach3));
+}
+
+unittest(compile_time_support_matches_the_table)
+{
+  // the same inputs through a DashState and a DashStateT<ArduinoSupport> give the same outputs
+  DashState table(ds);
+  DashStateT<ArduinoSupport> bound{ArduinoSupport(&FastLED)};
+  table.setup();
+  bound.setup();
+
+  state->digitalPin[SlavePin::Values::ignitionInput] = HIGH;
+  state->digitalPin[SlavePin::Values::tachometerWarning] = HIGH;
+  state->analogPin[SlavePin::Values::fuelInput] = 300;
+  DashMessage dm;
+  dm.setBit(MasterSignal::Values::acOn, true);
+  table.setMessage(dm);
+  bound.setMessage(dm);
+
+  for (unsigned long t = 1; t < 4000; t += 7) {
+    table.setSlaveState(digitalRead, analogRead);
+    bound.setSlaveState();
+    table.apply(t);
+    bound.apply(t);
+    assertEqual(table.lastStateString(t), bound.lastStateString(t));
+  }
+  for (unsigned int i = 0; i < NUM_DASH_LEDS; ++i) assertEqual(table.leds[i], bound.leds[i]);
+}
+
+// a support policy that only records the writes
+int mockWrites[32];
+struct RecordingSupport {
+  struct PinMode { void operator()(pin_size_t, uint8_t) const {} } pinMode;
+  struct AnalogRead { int operator()(pin_size_t) const { return 0; } } analogRead;
+  struct DigitalRead { int operator()(pin_size_t pin) const { return pin == SlavePin::Values::ignitionInput; } } digitalRead;
+  struct DigitalWrite { void operator()(pin_size_t pin, int val) const { mockWrites[pin] = val + 1; } } digitalWrite;
+  CFastLED* fastLed;
+};
+
+unittest(every_write_goes_through_the_support)
+{
+  for (unsigned int i = 0; i < 32; ++i) mockWrites[i] = 0;
+  DashStateT<RecordingSupport> mocked(RecordingSupport{{}, {}, {}, {}, &FastLED});
+  mocked.setup();
+  mocked.setSlaveState();
+  mocked.apply(10);
+
+  assertTrue(mocked.lastState.ignition);
+  assertEqual(LOW + 1, mockWrites[SlavePin::Values::optoCoupler]);
+  assertEqual(LOW + 1, mockWrites[SlavePin::Values::scrollCAN]);
+  assertEqual(0, state->digitalPin[SlavePin::Values::optoCoupler]);
+}
+
+unittest(quiet_master_means_failsafe)
+{
+  DashState local(ds);
+  local.setup();
+  local.link.staleTimeoutMs = LINK_STALE_TIMEOUT_MS;
+  state->digitalPin[SlavePin::Values::ignitionInput] = HIGH;
+
+  DashMessage dm;
+  dm.setBit(MasterSignal::Values::acOn, true);
+  local.setSlaveState(digitalRead, analogRead);
+  local.postMessage(dm, 100);
+  local.postSequence(1);
+  local.apply(100);
+  assertTrue(local.getLastState().getMasterSignal(MasterSignal::Values::acOn));
+
+  // nothing more from the master: the last word stands until the timeout, and then it's gone
+  local.apply(100 + LINK_STALE_TIMEOUT_MS);
+  assertTrue(local.getLastState().getMasterSignal(MasterSignal::Values::acOn));
+  local.apply(101 + LINK_STALE_TIMEOUT_MS);
+  assertFalse(local.getLastState().getMasterSignal(MasterSignal::Values::acOn));
+  assertTrue(local.lastStateString(101 + LINK_STALE_TIMEOUT_MS).indexOf("STALE") > 0);
+  assertEqual(failsafeDashMessage().binaryString(), local.getLastState().masterMessage.binaryString());
+
+  // and it's back as soon as the master is
+  local.postMessage(dm, 1000);
+  local.postSequence(3);
+  local.apply(1000);
+  assertTrue(local.getLastState().getMasterSignal(MasterSignal::Values::acOn));
+  assertTrue(local.lastStateString(1000).indexOf("lost 1 ooo 0") > 0);
+  assertEqual(1, local.link.staleCount);
+}
+
+unittest(failsafe_lights_nothing)
+{
+  // every signal in the failsafe is in the position that lights nothing, the inverted ones included
+  SlaveState failsafe;
+  failsafe.setMasterSignals(failsafeDashMessage());
+  for (unsigned int i = MASTERSIGNAL_MIN; i <= MASTERSIGNAL_MAX; ++i) {
+    const MasterSignal::Values signal = (MasterSignal::Values)i;
+    assertEqual(signal == MasterSignal::Values::hazardOff, failsafe.getMasterSignal(signal));
+  }
+
+  // and a dash that loses its master with everything on shows none of it
+  DashState local(ds);
+  local.setup();
+  local.link.staleTimeoutMs = LINK_STALE_TIMEOUT_MS;
+  state->digitalPin[SlavePin::Values::ignitionInput] = HIGH;
+  local.setSlaveState(digitalRead, analogRead);
+  local.postMessage(DashMessage(), 100); // hazardOff clear: the hazard lights are on
+  local.apply(100);
+  DashMessage everything;
+  for (unsigned int i = MASTERSIGNAL_MIN; i <= MASTERSIGNAL_MAX; ++i) everything.setBit((MasterSignal::Values)i, i != MasterSignal::Values::hazardOff);
+  local.postMessage(everything, 101);
+  local.apply(101);
+  const DashLED::Values indicators[] = {
+    DashLED::Values::airConditioningInd,
+    DashLED::Values::heatedRearWindowInd,
+    DashLED::Values::hazardInd,
+    DashLED::Values::rearFogLightInd,
+  };
+  for (unsigned int i = 0; i < sizeof(indicators) / sizeof(indicators[0]); ++i) {
+    assertNotEqual(CRGB(COLOR_BLACK), local.leds[indicators[i]]);
+  }
+
+  local.apply(102 + LINK_STALE_TIMEOUT_MS);
+  assertTrue(local.link.stale);
+  for (unsigned int i = 0; i < sizeof(indicators) / sizeof(indicators[0]); ++i) {
+    assertEqual(CRGB(COLOR_BLACK), local.leds[indicators[i]]);
   }
+  assertFalse(local.getLastState().getMasterSignal(MasterSignal::Values::boostWarning));
+  assertFalse(local.getLastState().getMasterSignal(MasterSignal::Values::boostCritical));
 }
 
 unittest_main()
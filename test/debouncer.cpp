@@ -85,6 +85,85 @@ unittest(bouncing_true)
   assertEqual(Debouncer::Event::none,   d1.eventOf(111, false));
 }
 
+unittest(bank_edges_come_out_together)
+{
+  DebouncerBank<uint16_t> bank;
+  bank.setStableTime(0x000F, 3);
+
+  // 4 signals go high at once and come out as one mask; an undebounced one is immediate
+  bank.process(100, 0x001F);
+  assertEqual(0x0010, bank.rose);
+  bank.process(101, 0x001F);
+  bank.process(102, 0x001F);
+  assertEqual(0, bank.rose);
+  bank.process(103, 0x001F);
+  assertEqual(0x000F, bank.rose);
+  assertEqual(0, bank.fell);
+  assertEqual(0x001F, bank.stable);
+  assertEqual(Debouncer::Event::toHigh, bank.eventOf(0x0001));
+
+  // and they fall together
+  bank.process(200, 0x0000);
+  assertEqual(0x0010, bank.fell);
+  bank.process(210, 0x0000);
+  assertEqual(0x000F, bank.fell);
+  assertEqual(Debouncer::Event::toLow, bank.eventOf(0x0001));
+  assertEqual(Debouncer::Event::none, bank.eventOf(0x0010));
+}
+
+unittest(bank_has_per_signal_stable_times)
+{
+  DebouncerBank<uint32_t> bank;
+  bank.setStableTime(0x00000001, 3);
+  bank.setStableTime(0x80000000, 50);
+
+  bank.process(100, 0x80000001);
+  bank.process(103, 0x80000001);
+  assertEqual(0x00000001, bank.rose);
+  bank.process(149, 0x80000001);
+  assertEqual(0, bank.rose);
+  bank.process(150, 0x80000001);
+  assertEqual(0x80000000, bank.rose);
+  assertTrue(bank.isHigh(0x80000000));
+}
+
+// a simple generator of bouncy signals
+uint32_t nextRandom(uint32_t &seed) {
+  seed = seed * 1664525 + 1013904223;
+  return seed >> 8;
+}
 
+unittest(bank_matches_individual_debouncers)
+{
+  // 16 signals with assorted stable times, polled at irregular intervals, must give
+  // exactly the events that 16 separate Debouncers give
+  const unsigned int stableTimes[16] = { 0, 1, 2, 3, 5, 8, 13, 21, 34, 50, 55, 63, 3, 3, 50, 50 };
+  DebouncerBank<uint16_t> bank;
+  Debouncer* single[16];
+  for (unsigned int i = 0; i < 16; ++i) {
+    bank.setStableTime(1 << i, stableTimes[i]);
+    single[i] = new Debouncer(stableTimes[i]);
+  }
+
+  uint32_t seed = 12345;
+  uint16_t reading = 0;
+  unsigned long t = 0;
+  unsigned long mismatches = 0;
+  unsigned long events = 0;
+  for (unsigned int step = 0; step < 20000; ++step) {
+    t += nextRandom(seed) % (step % 500 < 250 ? 3 : 40); // bursts of fast and slow polling
+    reading ^= (uint16_t)(nextRandom(seed) & nextRandom(seed) & nextRandom(seed)); // flip a few bits
+    bank.process(t, reading);
+    for (unsigned int i = 0; i < 16; ++i) {
+      const Debouncer::Event expected = single[i]->eventOf(t, reading & (1 << i));
+      if (expected != bank.eventOf(1 << i)) ++mismatches;
+      if (expected != Debouncer::Event::none) ++events;
+    }
+  }
+  for (unsigned int i = 0; i < 16; ++i) delete single[i];
+
+  assertEqual(0, mismatches);
+  assertMore(events, 1000);
+}
 
 unittest_main()
@@ -1,9 +1,12 @@
 #include <ArduinoUnitTests.h>
 #include "../src/LEDState.h"
+#include "../src/DashState.h"
+
+const struct LEDPosition origin = {0, 0};
 
 unittest(shimmer_distance_velocity_function)
 {
-  ShimmerState s({0, 0}, 6500, 0.025, 8, -2000, -1);
+  ShimmerState s(6500, 0.025, 8, -2000, -1);
   assertEqual(  0, s.velVsDistance(20000));
   assertEqual(  0, s.velVsDistance(10000));
   assertEqual(  0, s.velVsDistance(5000));
@@ -22,79 +25,79 @@ unittest(shimmer_distance_velocity_function)
 
 unittest(shimmer_distance_to_line)
 {
-  ShimmerState s1({0, 0}, 20001, 0, 1, 0, 0);
+  ShimmerState s1(20001, 0, 1, 0, 0);
   s1.m_activationTimeMs = 0;
-  assertEqual(20000, s1.distanceToLine(20000));
-  assertEqual(10000, s1.distanceToLine(10000));
-  assertEqual( 5000, s1.distanceToLine(5000));
-  assertEqual( 2000, s1.distanceToLine(2000));
-  assertEqual( 1000, s1.distanceToLine(1000));
-  assertEqual(  500, s1.distanceToLine(500));
-  assertEqual(  100, s1.distanceToLine(100));
-  assertEqual(   50, s1.distanceToLine(50));
-  assertEqual(   20, s1.distanceToLine(20));
-  assertEqual(   10, s1.distanceToLine(10));
-  assertEqual(    5, s1.distanceToLine(5));
-  assertEqual(    2, s1.distanceToLine(2));
-  assertEqual(    1, s1.distanceToLine(1));
-  assertEqual(    0, s1.distanceToLine(0));
-
-  ShimmerState s2({0, 0}, 20001, 0, 1, 1000, 0);
+  assertEqual(20000, s1.distanceToLine(origin, 20000));
+  assertEqual(10000, s1.distanceToLine(origin, 10000));
+  assertEqual( 5000, s1.distanceToLine(origin, 5000));
+  assertEqual( 2000, s1.distanceToLine(origin, 2000));
+  assertEqual( 1000, s1.distanceToLine(origin, 1000));
+  assertEqual(  500, s1.distanceToLine(origin, 500));
+  assertEqual(  100, s1.distanceToLine(origin, 100));
+  assertEqual(   50, s1.distanceToLine(origin, 50));
+  assertEqual(   20, s1.distanceToLine(origin, 20));
+  assertEqual(   10, s1.distanceToLine(origin, 10));
+  assertEqual(    5, s1.distanceToLine(origin, 5));
+  assertEqual(    2, s1.distanceToLine(origin, 2));
+  assertEqual(    1, s1.distanceToLine(origin, 1));
+  assertEqual(    0, s1.distanceToLine(origin, 0));
+
+  ShimmerState s2(20001, 0, 1, 1000, 0);
   s2.m_activationTimeMs = 0;
-  assertEqual(21000, s2.distanceToLine(20000));
-  assertEqual(11000, s2.distanceToLine(10000));
-  assertEqual( 6000, s2.distanceToLine(5000));
-  assertEqual( 3000, s2.distanceToLine(2000));
-  assertEqual( 2000, s2.distanceToLine(1000));
-  assertEqual( 1500, s2.distanceToLine(500));
-  assertEqual( 1100, s2.distanceToLine(100));
-  assertEqual( 1050, s2.distanceToLine(50));
-  assertEqual( 1020, s2.distanceToLine(20));
-  assertEqual( 1010, s2.distanceToLine(10));
-  assertEqual( 1005, s2.distanceToLine(5));
-  assertEqual( 1002, s2.distanceToLine(2));
-  assertEqual( 1001, s2.distanceToLine(1));
-  assertEqual( 1000, s2.distanceToLine(0));
+  assertEqual(21000, s2.distanceToLine(origin, 20000));
+  assertEqual(11000, s2.distanceToLine(origin, 10000));
+  assertEqual( 6000, s2.distanceToLine(origin, 5000));
+  assertEqual( 3000, s2.distanceToLine(origin, 2000));
+  assertEqual( 2000, s2.distanceToLine(origin, 1000));
+  assertEqual( 1500, s2.distanceToLine(origin, 500));
+  assertEqual( 1100, s2.distanceToLine(origin, 100));
+  assertEqual( 1050, s2.distanceToLine(origin, 50));
+  assertEqual( 1020, s2.distanceToLine(origin, 20));
+  assertEqual( 1010, s2.distanceToLine(origin, 10));
+  assertEqual( 1005, s2.distanceToLine(origin, 5));
+  assertEqual( 1002, s2.distanceToLine(origin, 2));
+  assertEqual( 1001, s2.distanceToLine(origin, 1));
+  assertEqual( 1000, s2.distanceToLine(origin, 0));
 
   // with a slope of -1, this should approximate the square root of 2
-  ShimmerState s3({0, 0}, 20001, 0, 1, 0, -1);
+  ShimmerState s3(20001, 0, 1, 0, -1);
   s3.m_activationTimeMs = 0;
-  assertEqual(14142, s3.distanceToLine(20000));
-  assertEqual( 7071, s3.distanceToLine(10000));
-  assertEqual( 3535, s3.distanceToLine(5000));
-  assertEqual( 1414, s3.distanceToLine(2000));
-  assertEqual(  707, s3.distanceToLine(1000));
-  assertEqual(  353, s3.distanceToLine(500));
-  assertEqual(   70, s3.distanceToLine(100));
-  assertEqual(   35, s3.distanceToLine(50));
-  assertEqual(   14, s3.distanceToLine(20));
-  assertEqual(    7, s3.distanceToLine(10));
-  assertEqual(    3, s3.distanceToLine(5));
-  assertEqual(    1, s3.distanceToLine(2));
-  assertEqual(    0, s3.distanceToLine(1));
-  assertEqual(    0, s3.distanceToLine(0));
-
-  ShimmerState s4({0, 0}, 6500, 0, 1, -2000, -1);
+  assertEqual(14142, s3.distanceToLine(origin, 20000));
+  assertEqual( 7071, s3.distanceToLine(origin, 10000));
+  assertEqual( 3535, s3.distanceToLine(origin, 5000));
+  assertEqual( 1414, s3.distanceToLine(origin, 2000));
+  assertEqual(  707, s3.distanceToLine(origin, 1000));
+  assertEqual(  353, s3.distanceToLine(origin, 500));
+  assertEqual(   70, s3.distanceToLine(origin, 100));
+  assertEqual(   35, s3.distanceToLine(origin, 50));
+  assertEqual(   14, s3.distanceToLine(origin, 20));
+  assertEqual(    7, s3.distanceToLine(origin, 10));
+  assertEqual(    3, s3.distanceToLine(origin, 5));
+  assertEqual(    1, s3.distanceToLine(origin, 2));
+  assertEqual(    0, s3.distanceToLine(origin, 1));
+  assertEqual(    0, s3.distanceToLine(origin, 0));
+
+  ShimmerState s4(6500, 0, 1, -2000, -1);
   s4.m_activationTimeMs = 0;
-  assertEqual(1060, s4.distanceToLine(20000));
-  assertEqual(1060, s4.distanceToLine(10000));
-  assertEqual(2121, s4.distanceToLine(5000));
-  assertEqual(   0, s4.distanceToLine(2000));
-  assertEqual( 707, s4.distanceToLine(1000));
-  assertEqual(1060, s4.distanceToLine(500));
-  assertEqual(1343, s4.distanceToLine(100));
-  assertEqual(1378, s4.distanceToLine(50));
-  assertEqual(1400, s4.distanceToLine(20));
-  assertEqual(1407, s4.distanceToLine(10));
-  assertEqual(1410, s4.distanceToLine(5));
-  assertEqual(1412, s4.distanceToLine(2));
-  assertEqual(1413, s4.distanceToLine(1));
-  assertEqual(1414, s4.distanceToLine(0));
+  assertEqual(1060, s4.distanceToLine(origin, 20000));
+  assertEqual(1060, s4.distanceToLine(origin, 10000));
+  assertEqual(2121, s4.distanceToLine(origin, 5000));
+  assertEqual(   0, s4.distanceToLine(origin, 2000));
+  assertEqual( 707, s4.distanceToLine(origin, 1000));
+  assertEqual(1060, s4.distanceToLine(origin, 500));
+  assertEqual(1343, s4.distanceToLine(origin, 100));
+  assertEqual(1378, s4.distanceToLine(origin, 50));
+  assertEqual(1400, s4.distanceToLine(origin, 20));
+  assertEqual(1407, s4.distanceToLine(origin, 10));
+  assertEqual(1410, s4.distanceToLine(origin, 5));
+  assertEqual(1412, s4.distanceToLine(origin, 2));
+  assertEqual(1413, s4.distanceToLine(origin, 1));
+  assertEqual(1414, s4.distanceToLine(origin, 0));
 }
 
 unittest(shimmer_animation_postion)
 {
-  ShimmerState s({0, 0}, 6500, 0.025, 8, -2000, -1);
+  ShimmerState s(6500, 0.025, 8, -2000, -1);
   s.m_activationTimeMs = 0;
   assertEqual(    0, s.animationPosition(6500));
   assertEqual(51992, s.animationPosition(6499));
@@ -112,7 +115,175 @@ unittest(shimmer_animation_postion)
   assertEqual(    0, s.animationPosition(0));
 }
 
+unittest(shimmer_fixed_point_matches_floating_point)
+{
+  // the falloff table should stay within 1 of the inverse square law it replaces
+  ShimmerState s(6500, 0.025, 8, -2000, -1);
+  for (unsigned long d = 0; d < 1000; ++d) {
+    const int expected = max(0, 255 - pow(d * 0.025, 2));
+    assertLessOrEqual(abs(expected - (int)s.velVsDistance(d)), 1);
+  }
+
+  // and so should the distance to the line, for LEDs all over the dash
+  const double slopes[] = { 1, -1, 0, 0.5, -2.25 };
+  for (unsigned int m = 0; m < 5; ++m) {
+    ShimmerState sm(6500, 0.025, 8, -6000, slopes[m]);
+    sm.m_activationTimeMs = 0;
+    for (unsigned int x = 0; x < 2200; x += 97) {
+      for (unsigned int y = 0; y < 1500; y += 89) {
+        const struct LEDPosition pos = {x, y};
+        const unsigned long t = (x * 7) + y;
+        const long b = -6000 + sm.animationPosition(t);
+        const double numerator = fabs((slopes[m] * x) - y + b);
+        const long expected = numerator / sqrt((slopes[m] * slopes[m]) + 1);
+        if (numerator < 0xFFFF) assertLessOrEqual(labs(expected - (long)sm.distanceToLine(pos, t)), 1);
+      }
+    }
+  }
+}
+
+unittest(solid_colors_are_written_as_given)
+{
+  // a color given as RGB is written exactly, with no trip through HSV
+  struct CRGB leds[1];
+  const struct LEDStrip strip = { leds, nullptr, 1, nullptr, nullptr, {} };
+  SolidColorState solid(COLOR_AMBER);
+  solid.loop(strip, 0, 0);
+  assertEqual(COLOR_AMBER, leds[0]);
+
+  FlashLoudState flash(solid);
+  leds[0] = COLOR_BLACK;
+  flash.loop(strip, 0, 0);
+  assertEqual(COLOR_AMBER, leds[0]);
+
+  // the debug view is still HSV
+  const struct CHSV hsv = rgb2hsv_approximate(COLOR_AMBER);
+  char expected[16];
+  sprintf(expected, "Sld %02X%02X%02X", hsv.h, hsv.s, hsv.v);
+  assertEqual(String(expected), solid.toStringWithParams(strip, 0, 0));
+}
+
+unittest(sparkle_flashes_once_per_window)
+{
+  SparkleState s;
+  struct CRGB leds[2];
+  struct LEDStrip strip = { leds, nullptr, 2, nullptr, nullptr, {} };
+
+  for (unsigned int index = 0; index < 2; ++index) {
+    // light exactly one flash of the sparkle duration per window
+    unsigned int litMs = 0;
+    for (unsigned long t = s.m_windowMs; t < s.m_windowMs * 2; ++t) {
+      s.loop(strip, index, t);
+      if (leds[index] == COLOR_WHITE) ++litMs;
+    }
+    assertEqual(s.m_sparkleDurationMs, litMs);
+
+    // the wake times land on the edges of the flash
+    const unsigned long flash = s.flashTime(index, s.m_windowMs);
+    if (s.m_windowMs < flash) assertEqual(flash, s.nextWakeTime(strip, index, s.m_windowMs));
+    assertEqual(flash + s.m_sparkleDurationMs, s.nextWakeTime(strip, index, flash));
+    assertEqual(s.m_windowMs * 2, s.nextWakeTime(strip, index, flash + s.m_sparkleDurationMs));
+  }
+
+  // different LEDs flash at different times
+  assertNotEqual(s.flashTime(0, s.m_windowMs), s.flashTime(1, s.m_windowMs));
+}
+
+unittest(effect_kernels_match_per_led_states)
+{
+  // whole-strip rendering should paint exactly what each LED's own state would have
+  const unsigned int numLEDs = 5;
+  const struct LEDPosition positions[numLEDs] = {{2023, 551}, {1633, 323}, {573, 90}, {252, 937}, {529, 1428}};
+  struct CRGB byKernel[numLEDs];
+  struct CRGB byState[numLEDs];
+  GlobalEffects effects;
+  const struct LEDStrip kernelStrip = { byKernel, positions, numLEDs, &effects, nullptr, {} };
+  const struct LEDStrip stateStrip  = { byState,  positions, numLEDs, &effects, nullptr, {} };
+
+  effects.shimmer.activate(1000);
+  for (unsigned long t = 1000; t < 8000; t += 37) {
+    effects.rainbow.render(kernelStrip, t);
+    for (unsigned int i = 0; i < numLEDs; ++i) effects.rainbow.loop(stateStrip, i, t);
+    for (unsigned int i = 0; i < numLEDs; ++i) assertEqual(byState[i], byKernel[i]);
+
+    effects.sparkle.render(kernelStrip, t);
+    for (unsigned int i = 0; i < numLEDs; ++i) effects.sparkle.loop(stateStrip, i, t);
+    for (unsigned int i = 0; i < numLEDs; ++i) assertEqual(byState[i], byKernel[i]);
+
+    effects.shimmer.render(kernelStrip, t);
+    for (unsigned int i = 0; i < numLEDs; ++i) effects.shimmer.loop(stateStrip, i, t);
+    for (unsigned int i = 0; i < numLEDs; ++i) assertEqual(byState[i], byKernel[i]);
+  }
+}
+
+unittest(shimmer_offsets_that_do_not_fit_are_worked_out)
+{
+  // a steep line puts the far LEDs' offsets outside 16 bits.  they aren't precomputed, and
+  // the shimmer is the same as if none were
+  const unsigned int numLEDs = 3;
+  const struct LEDPosition positions[numLEDs] = {{2023, 551}, {1000, 90}, {10, 1428}};
+  int16_t offsets[numLEDs];
+  struct CRGB precomputed[numLEDs];
+  struct CRGB computed[numLEDs];
+  const struct LEDStrip precomputedStrip = { precomputed, positions, numLEDs, nullptr, offsets, {} };
+  const struct LEDStrip computedStrip    = { computed,    positions, numLEDs, nullptr, nullptr, {} };
+
+  ShimmerState s(6500, 0.025, 300, -1000000, 40);
+  s.precompute(precomputedStrip);
+  assertEqual(SHIMMER_OFFSET_UNKNOWN, offsets[0]);
+  assertEqual(SHIMMER_OFFSET_UNKNOWN, offsets[1]);
+  assertEqual(s.lineOffset(positions[2]), offsets[2]);
+  assertMore(s.lineOffset(positions[0]), 32767);
+
+  s.activate(0);
+  unsigned int lit = 0;
+  for (unsigned long t = 0; t < 6500; t += 7) {
+    s.render(precomputedStrip, t);
+    s.render(computedStrip, t);
+    for (unsigned int i = 0; i < numLEDs; ++i) {
+      assertEqual(computed[i], precomputed[i]);
+      if (s.velVsDistance(s.distanceFromOffset(s.lineOffset(precomputedStrip, i), s.lineHeight(t)))) ++lit;
+    }
+  }
+  assertMore(lit, 0); // the line does pass the LEDs
+}
+
+unittest(global_effects_render_when_due)
+{
+  const unsigned int numLEDs = 3;
+  const struct LEDPosition positions[numLEDs] = {{0, 0}, {10, 10}, {20, 20}};
+  struct CRGB leds[numLEDs];
+  GlobalEffects effects;
+  const struct LEDStrip strip = { leds, positions, numLEDs, &effects, nullptr, {} };
 
+  // no effect means the LEDs are on their own
+  assertFalse(effects.render(strip, EffectMode::Values::none, 100));
+  assertEqual(0, effects.frames);
 
+  // the rainbow renders right away, then again every 5ms
+  assertTrue(effects.render(strip, EffectMode::Values::rainbow, 101));
+  assertEqual(1, effects.frames);
+  for (unsigned long t = 102; t < 105; ++t) assertTrue(effects.render(strip, EffectMode::Values::rainbow, t));
+  assertEqual(1, effects.frames);
+  assertTrue(effects.render(strip, EffectMode::Values::rainbow, 105));
+  assertEqual(2, effects.frames);
+
+  // switching effects renders right away, and restarts the shimmer
+  assertTrue(effects.render(strip, EffectMode::Values::shimmer, 106));
+  assertEqual(3, effects.frames);
+  assertEqual(106, effects.shimmer.m_activationTimeMs);
+}
+
+unittest(effect_states_are_shared)
+{
+  // an LED only carries its current state and its own local states.  the effects live once, in the DashState
+  assertEqual(sizeof(LEDState*) + 2 * sizeof(SolidColorState), sizeof(IlluminationLED));
+  assertEqual(sizeof(LEDState*) + sizeof(SolidColorState) + 4 * sizeof(FlashState), sizeof(TachLED));
+
+  // the budget for the whole DashState, as compiled for the unit tests; the board's own budget is
+  // checked where DashState is defined.  when every LED carried its own copy of the effect states,
+  // this was 9984 bytes
+  assertLessOrEqual(sizeof(DashState), 3904);
+}
 
 unittest_main()
@@ -0,0 +1,107 @@
+#include <ArduinoUnitTests.h>
+#include "../src/LinkMonitor.h"
+
+unittest(nothing_heard_is_only_stale_with_a_timeout)
+{
+  LinkMonitor never;
+  assertFalse(never.update(0));
+  assertFalse(never.update(100000));
+
+  LinkMonitor link(LINK_STALE_TIMEOUT_MS);
+  assertFalse(link.update(1000));
+  assertFalse(link.update(1000 + LINK_STALE_TIMEOUT_MS));
+  assertTrue(link.update(1001 + LINK_STALE_TIMEOUT_MS));
+  assertEqual(1, link.staleCount);
+}
+
+unittest(link_goes_stale_and_recovers)
+{
+  LinkMonitor link(200);
+  link.update(0);
+  for (unsigned long t = 0; t <= 1000; t += 100) {
+    link.frameArrived(t);
+    assertFalse(link.update(t + 50));
+  }
+
+  // the master goes quiet
+  assertFalse(link.update(1200));
+  assertTrue(link.update(1201));
+  assertTrue(link.update(5000));
+  assertEqual(1, link.staleCount);
+  assertEqual(String("lnk 0/s gap 100 jit 0 lost 0 ooo 0 STALE"), link.toString()); // a silent second
+
+  // and comes back
+  link.frameArrived(5001);
+  assertFalse(link.update(5002));
+  assertEqual(4001, link.longestGap);
+  assertEqual(1, link.staleCount);
+
+  // the summary has room for the biggest counts a board can have
+  link.framesPerSecond = link.longestGap = link.jitter16 = link.lost = link.outOfOrder = 4294967295ul;
+  link.stale = true;
+  assertEqual(String("lnk 4294967295/s gap 4294967295 jit 268435455 lost 4294967295 ooo 4294967295 STALE"), link.toString());
+}
+
+unittest(frames_per_second_are_counted_over_whole_seconds)
+{
+  LinkMonitor link;
+  link.update(0);
+  for (unsigned long t = 1; t < 1000; t += 20) link.frameArrived(t);
+  link.update(999);
+  assertEqual(0, link.framesPerSecond);
+  link.update(1000);
+  assertEqual(50, link.framesPerSecond);
+  for (unsigned long t = 1001; t < 2000; t += 100) link.frameArrived(t);
+  link.update(2000);
+  assertEqual(10, link.framesPerSecond);
+}
+
+unittest(jitter_follows_the_variation_in_gaps)
+{
+  LinkMonitor steady;
+  for (unsigned long t = 0; t < 2000; t += 100) steady.frameArrived(t);
+  assertEqual(0, steady.jitter16);
+
+  // gaps alternating between 90 and 110ms settle on a jitter of 20ms
+  LinkMonitor wobbly;
+  unsigned long t = 0;
+  for (unsigned int i = 0; i < 500; ++i) {
+    t += (i % 2) ? 90 : 110;
+    wobbly.frameArrived(t);
+  }
+  assertEqual(20, wobbly.jitter16 >> 4);
+  assertEqual(110, wobbly.longestGap);
+}
+
+unittest(sequence_numbers_show_loss_and_disorder)
+{
+  LinkMonitor link;
+  link.sequenceArrived(5);
+  link.sequenceArrived(6);
+  assertEqual(0, link.lost);
+
+  link.sequenceArrived(9); // 7 and 8 went missing
+  assertEqual(2, link.lost);
+
+  link.sequenceArrived(8); // a late one
+  link.sequenceArrived(9); // a repeat
+  assertEqual(2, link.outOfOrder);
+  assertEqual(9, link.lastSequence);
+
+  link.sequenceArrived(10);
+  assertEqual(2, link.lost);
+  assertEqual(2, link.outOfOrder);
+}
+
+unittest(sequence_numbers_wrap_around)
+{
+  LinkMonitor link;
+  for (unsigned int i = 0; i < 1000; ++i) link.sequenceArrived(i & LINK_SEQUENCE_MASK);
+  assertEqual(0, link.lost);
+  assertEqual(0, link.outOfOrder);
+
+  link.sequenceArrived((1000 + 3) & LINK_SEQUENCE_MASK);
+  assertEqual(3, link.lost);
+}
+
+unittest_main()
@@ -0,0 +1,109 @@
+#include <ArduinoUnitTests.h>
+#include "../src/MasterInputs.h"
+
+// mock the pin_size_t available on some boards
+#ifndef pin_size_t
+  typedef uint8_t pin_size_t;
+#endif
+
+int fakeDigitalRead(pin_size_t pin) {
+  return digitalRead(pin);
+}
+
+// handle to godmode state so we can control inputs
+GodmodeState* state = GODMODE();
+
+unittest_setup() {
+  state->reset();
+}
+
+unittest(nothing_pressed_sends_nothing)
+{
+  MasterInputs mi;
+  mi.capture(fakeDigitalRead, 0);
+  assertEqual(0, mi.captures);
+  assertEqual(0, mi.signals(0));
+  assertEqual(DashMessage(fakeDigitalRead).binaryString(), mi.message(0).binaryString());
+}
+
+unittest(levels_follow_the_pins)
+{
+  MasterInputs mi;
+  state->digitalPin[MasterPin::Values::acOn] = HIGH;
+  state->digitalPin[MasterPin::Values::scrollBrightness] = HIGH;
+  mi.capture(fakeDigitalRead, 10);
+  assertEqual(1, mi.captures);
+
+  const MasterEdges e = mi.take();
+  assertEqual(masterSignalOf(MasterSignal::Values::acOn) | masterSignalOf(MasterSignal::Values::scrollBrightness), e.level);
+  assertEqual(e.level, e.rose);
+  assertEqual(0, e.fell);
+
+  // the edges are gone once they're taken, the levels aren't
+  const MasterEdges again = mi.take();
+  assertEqual(e.level, again.level);
+  assertEqual(0, again.rose);
+
+  // the message matches one made from the pins directly
+  assertEqual(DashMessage(fakeDigitalRead).binaryString(), mi.message(10 + WIRE_PROTOCOL_MIN_PULSE_MS).binaryString());
+}
+
+unittest(short_press_between_loops_is_not_lost)
+{
+  MasterInputs mi;
+  // the button goes down and up again before the loop looks
+  state->digitalPin[MasterPin::Values::scrollCAN] = HIGH;
+  mi.capture(fakeDigitalRead, 100);
+  state->digitalPin[MasterPin::Values::scrollCAN] = LOW;
+  mi.capture(fakeDigitalRead, 103);
+  assertEqual(2, mi.captures);
+
+  // the loop still sees it, and keeps it up for the minimum pulse
+  DashMessage dm = mi.message(110);
+  assertTrue(dm.getBit(MasterSignal::Values::scrollCAN));
+  assertTrue(mi.message(100 + WIRE_PROTOCOL_MIN_PULSE_MS - 1).getBit(MasterSignal::Values::scrollCAN));
+  assertFalse(mi.message(100 + WIRE_PROTOCOL_MIN_PULSE_MS).getBit(MasterSignal::Values::scrollCAN));
+}
+
+unittest(long_press_follows_the_pin)
+{
+  MasterInputs mi;
+  state->digitalPin[MasterPin::Values::hazardOff] = HIGH;
+  mi.capture(fakeDigitalRead, 0);
+  assertTrue(mi.message(1).getBit(MasterSignal::Values::hazardOff));
+  assertTrue(mi.message(500).getBit(MasterSignal::Values::hazardOff));
+
+  state->digitalPin[MasterPin::Values::hazardOff] = LOW;
+  mi.capture(fakeDigitalRead, 501);
+  const MasterEdges e = mi.take();
+  assertEqual(masterSignalOf(MasterSignal::Values::hazardOff), e.fell);
+  assertFalse(mi.message(502).getBit(MasterSignal::Values::hazardOff));
+}
+
+unittest(pulse_is_timed_from_the_edge_not_the_loop)
+{
+  MasterInputs mi;
+  state->digitalPin[MasterPin::Values::acOn] = HIGH;
+  mi.capture(fakeDigitalRead, 1000);
+  state->digitalPin[MasterPin::Values::acOn] = LOW;
+  mi.capture(fakeDigitalRead, 1001);
+
+  // the loop was busy for longer than the pulse; it still sends the press once
+  assertTrue(mi.message(1000 + WIRE_PROTOCOL_MIN_PULSE_MS + 20).getBit(MasterSignal::Values::acOn));
+  assertFalse(mi.message(1000 + WIRE_PROTOCOL_MIN_PULSE_MS + 21).getBit(MasterSignal::Values::acOn));
+}
+
+unittest(pulse_survives_millis_rollover)
+{
+  MasterInputs mi;
+  const unsigned long t = 0ul - 16;
+  state->digitalPin[MasterPin::Values::rearFoggerOn] = HIGH;
+  mi.capture(fakeDigitalRead, t);
+  state->digitalPin[MasterPin::Values::rearFoggerOn] = LOW;
+  mi.capture(fakeDigitalRead, t + 1);
+
+  assertTrue(mi.message(t + 20).getBit(MasterSignal::Values::rearFoggerOn));
+  assertFalse(mi.message(t + WIRE_PROTOCOL_MIN_PULSE_MS).getBit(MasterSignal::Values::rearFoggerOn));
+}
+
+unittest_main()
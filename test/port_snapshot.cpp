@@ -0,0 +1,83 @@
+#include <ArduinoUnitTests.h>
+#include "../src/PortSnapshot.h"
+#include "../src/DashMessage.h"
+#include "../src/SlaveProperties.h"
+
+int fakeDigitalRead(pin_size_t pin) {
+  return digitalRead(pin);
+}
+
+int fakeAnalogRead(pin_size_t pin) {
+  return analogRead(pin);
+}
+
+// handle to godmode state so we can control inputs
+GodmodeState* state = GODMODE();
+
+unittest_setup() {
+  state->reset();
+}
+
+unittest(every_pin_has_its_own_bit)
+{
+  for (pin_size_t a = 0; a < GPIO_PIN_COUNT; ++a) {
+    for (pin_size_t b = a + 1; b < GPIO_PIN_COUNT; ++b) {
+      assertFalse(gpioPortOf(a) == gpioPortOf(b) && gpioMaskOf(a) == gpioMaskOf(b));
+    }
+    assertLess(gpioPortOf(a), GPIO_PORT_COUNT);
+  }
+}
+
+unittest(snapshot_matches_digital_read)
+{
+  state->digitalPin[3] = HIGH;
+  state->digitalPin[9] = HIGH;
+  state->digitalPin[A0] = HIGH;
+
+  const PortSnapshot ports = PortSnapshot::sample();
+  for (pin_size_t p = 0; p < GPIO_PIN_COUNT; ++p) {
+    assertEqual(digitalRead(p) == HIGH, ports.isHigh(p));
+  }
+
+  PortSnapshot injected;
+  injected.setFromPins(fakeDigitalRead);
+  for (uint8_t i = 0; i < GPIO_PORT_COUNT; ++i) assertEqual(ports.port[i], injected.port[i]);
+}
+
+unittest(snapshot_is_a_moment_in_time)
+{
+  state->digitalPin[MasterPin::Values::acOn] = HIGH;
+  const PortSnapshot ports = PortSnapshot::sample();
+  state->digitalPin[MasterPin::Values::acOn] = LOW;
+  assertTrue(ports.isHigh(MasterPin::Values::acOn));
+}
+
+unittest(master_message_from_ports_matches_pins)
+{
+  for (int mask = 0; mask < 1024; mask += 37) {
+    for (unsigned int i = 0; i < 10; ++i) state->digitalPin[MasterPin::Values::boostWarning + i] = (mask >> i) & 1;
+    assertEqual(DashMessage(fakeDigitalRead).binaryString(), DashMessage(PortSnapshot::sample()).binaryString());
+  }
+}
+
+unittest(slave_state_from_ports_matches_pins)
+{
+  state->digitalPin[SlavePin::Values::backlightDim]      = HIGH;
+  state->digitalPin[SlavePin::Values::tachometerWarning] = HIGH;
+  state->digitalPin[SlavePin::Values::ignitionInput]     = HIGH;
+  state->analogPin[SlavePin::Values::fuelInput]          = 123;
+  state->analogPin[SlavePin::Values::oilInput]           = 456;
+
+  SlaveState fromPins;
+  SlaveState fromPorts;
+  fromPins.setFromPins(fakeDigitalRead, fakeAnalogRead);
+  fromPorts.setFromPorts(PortSnapshot::sample(), fakeAnalogRead);
+  assertEqual(fromPins.toString(), fromPorts.toString());
+  assertTrue(fromPorts.backlightDim);
+  assertFalse(fromPorts.tachometerCritical);
+  assertTrue(fromPorts.tachometerWarning);
+  assertTrue(fromPorts.ignition);
+  assertEqual(123, fromPorts.fuelLevel);
+}
+
+unittest_main()
@@ -83,24 +83,124 @@ unittest(SlaveState_effectmode)
   assertEqual(EffectMode::Values::none, astate.effectmode.state);
 }
 
-unittest(SlaveState_scrollCAN)
+unittest(SlaveState_is_a_compact_sample)
 {
+  // the inputs pack into 10 bytes: 3 readings, the message, 4 bits, and the effect mode
+  assertEqual(3 * sizeof(int16_t) + WIRE_PROTOCOL_MESSAGE_LENGTH + 1 + sizeof(EffectMode), sizeof(SlaveState));
+
+  // and a copy carries all of them
   SlaveState astate;
-  assertEqual(0, astate.CANPulseBegin);
-  assertEqual(false, astate.scrollCANstate(0));
-  assertEqual(false, astate.scrollCANstate(1));
-  assertEqual(false, astate.scrollCANstate(49));
-  assertEqual(false, astate.scrollCANstate(50));
-  assertEqual(false, astate.scrollCANstate(51));
-
-  astate.CANPulseBegin = 100;
-  assertEqual(100, astate.CANPulseBegin);
-  assertEqual(false, astate.scrollCANstate(99));
-  assertEqual(true, astate.scrollCANstate(100));
-  assertEqual(true, astate.scrollCANstate(101));
-  assertEqual(true, astate.scrollCANstate(149));
-  assertEqual(false, astate.scrollCANstate(150));
-  assertEqual(false, astate.scrollCANstate(151));
+  astate.fuelLevel = 1023;
+  astate.masterMessage.setBit(MasterSignal::Values::acOn, true);
+  astate.tachometerWarning = true;
+  astate.effectmode.state = EffectMode::Values::shimmer;
+  SlaveState bstate = astate;
+  assertEqual(1023, bstate.fuelLevel);
+  assertTrue(bstate.getMasterSignal(MasterSignal::Values::acOn));
+  assertTrue(bstate.tachometerWarning);
+  assertFalse(bstate.tachometerCritical);
+  assertEqual(EffectMode::Values::shimmer, bstate.effectmode.state);
+}
+
+unittest(SlaveEvents_scrollCAN)
+{
+  SlaveEvents events;
+  assertEqual(0, events.CANPulseBegin);
+  assertEqual(false, events.scrollCANstate(0));
+  assertEqual(false, events.scrollCANstate(1));
+  assertEqual(false, events.scrollCANstate(49));
+  assertEqual(false, events.scrollCANstate(50));
+  assertEqual(false, events.scrollCANstate(51));
+
+  events.CANPulseBegin = 100;
+  assertEqual(100, events.CANPulseBegin);
+  assertEqual(false, events.scrollCANstate(99));
+  assertEqual(true, events.scrollCANstate(100));
+  assertEqual(true, events.scrollCANstate(101));
+  assertEqual(true, events.scrollCANstate(149));
+  assertEqual(false, events.scrollCANstate(150));
+  assertEqual(false, events.scrollCANstate(151));
+}
+
+unittest(SlaveEvents_step_the_effect_mode)
+{
+  SlaveEvents events;
+  SlaveState sample;
+  sample.masterMessage.setBit(MasterSignal::Values::scrollRainbowEffects, true);
+  events.debounce(10, sample);
+  assertEqual(EffectMode::Values::none, sample.effectmode.state);
+  events.debounce(10 + DEBOUNCE_TIME_MS, sample);
+  assertEqual(EffectMode::Values::rainbow, sample.effectmode.state);
+  assertEqual(String("/"), events.toString());
+
+  // a held button doesn't step it again, and a reset forgets the press
+  events.debounce(20 + DEBOUNCE_TIME_MS, sample);
+  assertEqual(EffectMode::Values::rainbow, sample.effectmode.state);
+  events.reset();
+  assertEqual(String("_"), events.toString());
+  events.debounce(30 + DEBOUNCE_TIME_MS, sample);
+  events.debounce(30 + 2 * DEBOUNCE_TIME_MS, sample);
+  assertEqual(EffectMode::Values::sparkle, sample.effectmode.state);
+}
+
+unittest(SlaveEvents_stabilize_the_sample)
+{
+  // setSignals() is the inverse of signals(), and leaves the fields and framing alone
+  SlaveState sample;
+  sample.masterMessage.setField<MasterField::boostPressure>(11);
+  const SlaveSignalMask every = (SlaveSignalMask)(signalOf(SlaveSignal::Values::tachometerCritical) << 1) - 1;
+  sample.setSignals(every);
+  assertEqual(every, sample.signals());
+  assertTrue(sample.ignition);
+  assertTrue(sample.tachometerCritical);
+  assertTrue(sample.getMasterSignal(MasterSignal::Values::scrollBrightness));
+  assertEqual(11, sample.masterMessage.getField<MasterField::boostPressure>());
+  assertTrue(sample.masterMessage.rawData[0] & FIRST_FRAME_MARKER_MASK);
+  sample.setSignals(0);
+  assertEqual(0, sample.signals());
+  assertEqual(11, sample.masterMessage.getField<MasterField::boostPressure>());
+
+  // a signal given a stable time only changes in the stabilized copy once it's held
+  SlaveEvents events;
+  events.debouncer.setStableTime(signalOf(SlaveSignal::Values::backlightDim), 20);
+  sample.backlightDim = true;
+  sample.masterMessage.setBit(MasterSignal::Values::acOn, true);
+  events.debounce(100, sample);
+  SlaveState stable = sample;
+  events.stabilize(stable);
+  assertFalse(stable.backlightDim);
+  assertTrue(stable.getMasterSignal(MasterSignal::Values::acOn)); // no stable time: it's taken as-is
+  assertTrue(sample.backlightDim);                                // and the raw sample is untouched
+
+  events.debounce(120, sample);
+  stable = sample;
+  events.stabilize(stable);
+  assertTrue(stable.backlightDim);
+}
+
+unittest(SlaveState_changed_led_inputs)
+{
+  SlaveState a;
+  SlaveState b;
+  assertEqual(LED_INPUT_NONE, a.changedLEDInputs(b));
+
+  // master signals map to their own positions, across message bytes
+  b.masterMessage.setBit(MasterSignal::Values::acOn, true);
+  b.masterMessage.setBit(MasterSignal::Values::scrollBrightness, true);
+  assertEqual(ledInputOf(MasterSignal::Values::acOn) | ledInputOf(MasterSignal::Values::scrollBrightness), a.changedLEDInputs(b));
+  assertEqual(a.changedLEDInputs(b), b.changedLEDInputs(a));
+
+  // slave inputs come after the master signals
+  b = a;
+  b.tachometerWarning = true;
+  b.effectmode.state = EffectMode::Values::sparkle;
+  assertEqual(ledInputOf(LEDInput::Values::tachometerWarning) | ledInputOf(LEDInput::Values::effectMode), a.changedLEDInputs(b));
+
+  // things the LEDs don't look at don't count
+  b = a;
+  b.fuelLevel = 500;
+  b.backlightDim = true;
+  assertEqual(LED_INPUT_NONE, a.changedLEDInputs(b));
 }
 
 unittest_main()
@@ -0,0 +1,244 @@
+#include <ArduinoUnitTests.h>
+#include "../src/StripRenderer.h"
+
+const unsigned int NUM_TEST_LEDS = 4;
+
+unittest(first_frame_is_always_pushed)
+{
+  CFastLED fastLed;
+  StripRenderer<NUM_TEST_LEDS> r(10);
+  struct CRGB leds[NUM_TEST_LEDS];
+  for (unsigned int i = 0; i < NUM_TEST_LEDS; ++i) leds[i] = CRGB(0, 0, 0);
+
+  assertTrue(r.render(&fastLed, leds, 100, 0));
+  assertEqual(1, fastLed.numShows);
+  assertEqual(100, fastLed.brightness);
+  assertEqual(1, r.framesPushed);
+  assertEqual(0, r.framesSkipped);
+  assertEqual(0, r.framesThrottled);
+  assertEqual(String("px 1 sk 0 th 0 pix 4"), r.toString());
+
+  // the summary has room for the biggest counts a board can have
+  r.framesPushed = r.framesSkipped = r.framesThrottled = r.pixelsPushed = 4294967295ul;
+  assertEqual(String("px 4294967295 sk 4294967295 th 4294967295 pix 4294967295"), r.toString());
+}
+
+unittest(unchanged_frames_are_skipped)
+{
+  CFastLED fastLed;
+  StripRenderer<NUM_TEST_LEDS> r(10);
+  struct CRGB leds[NUM_TEST_LEDS];
+  for (unsigned int i = 0; i < NUM_TEST_LEDS; ++i) leds[i] = CRGB(1, 2, 3);
+
+  assertTrue(r.render(&fastLed, leds, 100, 0));
+  for (unsigned long t = 1; t < 1000; ++t) {
+    assertFalse(r.render(&fastLed, leds, 100, t));
+  }
+  assertEqual(1,   fastLed.numShows);
+  assertEqual(1,   r.framesPushed);
+  assertEqual(999, r.framesSkipped);
+  assertEqual(0,   r.framesThrottled);
+}
+
+unittest(pixel_and_brightness_changes_are_pushed)
+{
+  CFastLED fastLed;
+  StripRenderer<NUM_TEST_LEDS> r(10);
+  struct CRGB leds[NUM_TEST_LEDS];
+  for (unsigned int i = 0; i < NUM_TEST_LEDS; ++i) leds[i] = CRGB(1, 2, 3);
+
+  assertTrue(r.render(&fastLed, leds, 100, 0));
+
+  // a pixel change
+  leds[3] = CRGB(4, 5, 6);
+  assertTrue(r.isDirty(leds, 100));
+  assertTrue(r.render(&fastLed, leds, 100, 20));
+  assertFalse(r.isDirty(leds, 100));
+
+  // a brightness change
+  assertTrue(r.isDirty(leds, 50));
+  assertTrue(r.render(&fastLed, leds, 50, 40));
+  assertEqual(50, fastLed.brightness);
+
+  assertEqual(3, fastLed.numShows);
+  assertEqual(3, r.framesPushed);
+}
+
+unittest(refresh_rate_is_capped)
+{
+  CFastLED fastLed;
+  StripRenderer<NUM_TEST_LEDS> r(10);
+  struct CRGB leds[NUM_TEST_LEDS];
+  for (unsigned int i = 0; i < NUM_TEST_LEDS; ++i) leds[i] = CRGB(1, 2, 3);
+
+  assertTrue(r.render(&fastLed, leds, 100, 0));
+
+  // a change that comes too soon is held back, but not forgotten
+  leds[0] = CRGB(9, 9, 9);
+  assertFalse(r.render(&fastLed, leds, 100, 5));
+  assertFalse(r.render(&fastLed, leds, 100, 9));
+  assertEqual(2, r.framesThrottled);
+  assertTrue(r.render(&fastLed, leds, 100, 10));
+  assertEqual(2, fastLed.numShows);
+
+  // an animation that changes every millisecond only gets 100 frames per second
+  for (unsigned long t = 11; t <= 1010; ++t) {
+    leds[1] = CRGB(t % 256, 0, 0);
+    r.render(&fastLed, leds, 100, t);
+  }
+  assertEqual(102, fastLed.numShows);
+}
+
+unittest(reset_forces_a_push)
+{
+  CFastLED fastLed;
+  StripRenderer<NUM_TEST_LEDS> r(10);
+  struct CRGB leds[NUM_TEST_LEDS];
+  for (unsigned int i = 0; i < NUM_TEST_LEDS; ++i) leds[i] = CRGB(1, 2, 3);
+
+  assertTrue(r.render(&fastLed, leds, 100, 0));
+  r.reset();
+  assertEqual(0, r.framesPushed);
+  assertTrue(r.render(&fastLed, leds, 100, 1));
+}
+
+unittest(dirty_length_finds_last_changed_pixel)
+{
+  StripRenderer<NUM_TEST_LEDS> r(10);
+  CFastLED fastLed;
+  struct CRGB leds[NUM_TEST_LEDS];
+  for (unsigned int i = 0; i < NUM_TEST_LEDS; ++i) leds[i] = CRGB(1, 2, 3);
+
+  // nothing shown yet, or a brightness change, means everything
+  assertEqual(NUM_TEST_LEDS, r.dirtyLength(leds, 100));
+  r.render(&fastLed, leds, 100, 0);
+  assertEqual(0, r.dirtyLength(leds, 100));
+  assertEqual(NUM_TEST_LEDS, r.dirtyLength(leds, 99));
+
+  leds[1] = CRGB(7, 7, 7);
+  assertEqual(2, r.dirtyLength(leds, 100));
+  leds[0] = CRGB(7, 7, 7);
+  assertEqual(2, r.dirtyLength(leds, 100));
+  leds[3] = CRGB(7, 7, 7);
+  assertEqual(4, r.dirtyLength(leds, 100));
+}
+
+unittest(dirty_prefix_mode_sends_only_the_prefix)
+{
+  CFastLED fastLed;
+  StripRenderer<NUM_TEST_LEDS> r(10);
+  struct CRGB leds[NUM_TEST_LEDS];
+  for (unsigned int i = 0; i < NUM_TEST_LEDS; ++i) leds[i] = CRGB(1, 2, 3);
+
+  r.mode = RenderMode::Values::dirtyPrefix;
+  r.controller = &fastLed.addLeds<WS2812B, 11, GRB>(leds, NUM_TEST_LEDS);
+
+  // first frame is the whole strip, and it doesn't go through FastLED.show()
+  assertTrue(r.render(&fastLed, leds, 100, 0));
+  assertEqual(0, fastLed.numShows);
+  assertEqual(1, fastLed.controller.numPushes);
+  assertEqual(NUM_TEST_LEDS, fastLed.controller.lastPushPixels);
+
+  // a change in the middle only sends up to that point
+  leds[1] = CRGB(7, 7, 7);
+  assertTrue(r.render(&fastLed, leds, 100, 10));
+  assertEqual(2, fastLed.controller.numPushes);
+  assertEqual(2, fastLed.controller.lastPushPixels);
+
+  // throttled changes accumulate into one prefix
+  leds[0] = CRGB(8, 8, 8);
+  assertTrue(r.render(&fastLed, leds, 100, 20));
+  leds[2] = CRGB(8, 8, 8);
+  assertFalse(r.render(&fastLed, leds, 100, 21));
+  leds[0] = CRGB(9, 9, 9);
+  assertTrue(r.render(&fastLed, leds, 100, 30));
+  assertEqual(4, fastLed.controller.numPushes);
+  assertEqual(3, fastLed.controller.lastPushPixels);
+
+  // brightness always sends everything
+  assertTrue(r.render(&fastLed, leds, 50, 40));
+  assertEqual(NUM_TEST_LEDS, fastLed.controller.lastPushPixels);
+  assertEqual(NUM_TEST_LEDS + 2 + 1 + 3 + NUM_TEST_LEDS, r.pixelsPushed);
+  assertEqual(r.pixelsPushed, fastLed.controller.pixelsPushed);
+}
+
+unittest(full_frame_mode_sends_everything)
+{
+  CFastLED fastLed;
+  StripRenderer<NUM_TEST_LEDS> r(10);
+  struct CRGB leds[NUM_TEST_LEDS];
+  for (unsigned int i = 0; i < NUM_TEST_LEDS; ++i) leds[i] = CRGB(1, 2, 3);
+  r.controller = &fastLed.addLeds<WS2812B, 11, GRB>(leds, NUM_TEST_LEDS);
+
+  assertTrue(r.render(&fastLed, leds, 100, 0));
+  leds[0] = CRGB(7, 7, 7);
+  assertTrue(r.render(&fastLed, leds, 100, 10));
+  assertEqual(2, fastLed.numShows);
+  assertEqual(NUM_TEST_LEDS, fastLed.controller.lastPushPixels);
+  assertEqual(NUM_TEST_LEDS * 2, r.pixelsPushed);
+}
+
+unittest(the_strip_logs_each_push)
+{
+  CFastLED fastLed;
+  StripRenderer<NUM_TEST_LEDS> r(10);
+  struct CRGB leds[NUM_TEST_LEDS];
+  for (unsigned int i = 0; i < NUM_TEST_LEDS; ++i) leds[i] = CRGB(1, 2, 3);
+  r.controller = &fastLed.addLeds<WS2812B, 11, GRB>(leds, NUM_TEST_LEDS);
+
+  GODMODE()->micros = 5000;
+  assertTrue(r.render(&fastLed, leds, 100, 5));
+  assertEqual(1, fastLed.controller.logged());
+  assertEqual(5, fastLed.controller.recentFrame(0).time);
+  assertEqual(NUM_TEST_LEDS, fastLed.controller.recentFrame(0).pixels);
+  assertEqual(100, fastLed.controller.recentFrame(0).brightness);
+
+  // other pixels hash differently, and the same ones the same
+  const uint32_t first = fastLed.controller.recentFrame(0).hash;
+  leds[3] = CRGB(3, 2, 1);
+  GODMODE()->micros = 15000;
+  assertTrue(r.render(&fastLed, leds, 100, 15));
+  assertNotEqual(first, fastLed.controller.recentFrame(0).hash);
+  assertEqual(first, fastLed.controller.recentFrame(1).hash);
+  assertEqual(15, fastLed.controller.recentFrame(0).time);
+
+  // the renderer never sends the same frame twice; showing it again by hand does
+  assertEqual(0, fastLed.controller.repeatPushes);
+  fastLed.show();
+  assertEqual(1, fastLed.controller.repeatPushes);
+
+  // the log keeps only the most recent pushes
+  for (unsigned int i = 0; i < FAKE_FRAME_LOG_LENGTH * 2; ++i) {
+    fastLed.setBrightness(i);
+    fastLed.show();
+  }
+  assertEqual(FAKE_FRAME_LOG_LENGTH, fastLed.controller.logged());
+  assertEqual(FAKE_FRAME_LOG_LENGTH * 2 - 1, fastLed.controller.recentFrame(0).brightness);
+  assertEqual(FAKE_FRAME_LOG_LENGTH, fastLed.controller.recentFrame(FAKE_FRAME_LOG_LENGTH - 1).brightness);
+
+  fastLed.controller.clearLog();
+  assertEqual(0, fastLed.controller.logged());
+  GODMODE()->micros = 0;
+}
+
+unittest(pushes_per_window_are_capped_by_the_frame_interval)
+{
+  CFastLED fastLed;
+  StripRenderer<NUM_TEST_LEDS> r(10);
+  struct CRGB leds[NUM_TEST_LEDS];
+  r.controller = &fastLed.addLeds<WS2812B, 11, GRB>(leds, NUM_TEST_LEDS);
+
+  // a frame that changes every ms
+  for (unsigned long t = 1; t <= 1000; ++t) {
+    GODMODE()->micros = t * 1000;
+    for (unsigned int i = 0; i < NUM_TEST_LEDS; ++i) leds[i] = CRGB(t, i, 0);
+    r.render(&fastLed, leds, 100, t);
+  }
+  assertEqual(100, r.framesPushed);
+  assertEqual(10, fastLed.controller.maxPushesWithin(100));
+  assertEqual(1, fastLed.controller.maxPushesWithin(10));
+  assertEqual(0, fastLed.controller.repeatPushes);
+  GODMODE()->micros = 0;
+}
+
+unittest_main()